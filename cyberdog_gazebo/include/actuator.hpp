@@ -18,13 +18,146 @@
 #include <math.h>
 #include <stdio.h>
 
+#include <algorithm>
+
+#include <eigen3/Eigen/Dense>
+
 #include "ctrl_ros/utilities/utilities.h"
+#include "async_logger.hpp"
 
 
 
 
 namespace gazebo
 {
+  /**
+   * @brief Cubic I-tau curve I = a tau^3 + b tau^2 + c tau of a motor and its
+   *        inverse at a fixed cost: a table uniform in current over
+   *        [-2 tau_max, 2 tau_max] gives a first guess, one Newton step polishes
+   *        it. Beyond the table the guess is the closed form root of the cubic.
+   *        The curve is monotone for the motor coefficients (b^2 < 3ac), so
+   *        the cubic has a single real root
+   */
+  class ITauCurve
+  {
+  public:
+    static constexpr int kTableSize = 256;
+
+    /**
+     * @brief Construct a new ITauCurve object
+     * 
+     * @param a       : coefficient of I-tau curve
+     * @param b       : coefficient of I-tau curve
+     * @param c       : coefficient of I-tau curve
+     * @param tau_max : maximum torque, the table covers twice this range
+     */
+    ITauCurve(double a = 0.0022, double b = -0.0067, double c = 1.1246, double tau_max = 12.001)
+    {
+      Init(a, b, c, tau_max);
+    }
+
+    void Init(double a, double b, double c, double tau_max)
+    {
+      a_ = a;
+      b_ = b;
+      c_ = c;
+      tau_max_ = tau_max;
+      i_min_ = Current(-2 * tau_max);
+      double i_max = Current(2 * tau_max);
+      step_ = (i_max - i_min_) / kTableSize;
+      for (int k = 0; k <= kTableSize; k++) {
+        table_[k] = TorqueIterative(i_min_ + k * step_, 0.0);
+      }
+
+      // tau = u - shift turns the curve into u^3 + p u + q = current / a
+      if (a_ > 0) {
+        shift_ = b_ / (3 * a_);
+        p_ = (3 * a_ * c_ - b_ * b_) / (3 * a_ * a_);
+        q_ = (2 * b_ * b_ * b_ - 9 * a_ * b_ * c_) / (27 * a_ * a_ * a_);
+      }
+    }
+
+    /**
+     * @brief Motor current of a torque
+     */
+    double Current(double tau) const
+    {
+      return ((a_ * tau + b_) * tau + c_) * tau;
+    }
+
+    /**
+     * @brief Derivative of the current with respect to torque
+     */
+    double Slope(double tau) const
+    {
+      return (3 * a_ * tau + 2 * b_) * tau + c_;
+    }
+
+    /**
+     * @brief The current is within the range of the table
+     */
+    bool InTable(double current) const
+    {
+      double x = (current - i_min_) / step_;
+      return x >= 0 && x <= kTableSize;
+    }
+
+    /**
+     * @brief Linear interpolation of the table, the root of the cubic beyond
+     *        its ends. Both cost the same whatever the current
+     */
+    double Guess(double current) const
+    {
+      double x = (current - i_min_) / step_;
+      if ((x < 0 || x > kTableSize) && a_ > 0) {
+        // Cardano, one real root since p > 0. Beyond the table |q'| is large,
+        // the two cube roots differ in magnitude and do not cancel
+        double q = q_ - current / a_;
+        double d = sqrt(q * q / 4 + p_ * p_ * p_ / 27);
+        return cbrt(-q / 2 + d) + cbrt(-q / 2 - d) - shift_;
+      }
+      int k = std::min(std::max(int(floor(x)), 0), kTableSize - 1);
+      return table_[k] + (x - k) * (table_[k + 1] - table_[k]);
+    }
+
+    /**
+     * @brief Torque of a motor current, guess and one Newton step
+     */
+    double Torque(double current) const
+    {
+      double tau = Guess(current);
+      return tau - (Current(tau) - current) / Slope(tau);
+    }
+
+    /**
+     * @brief Torque of a motor current by Newton iteration, for building the table
+     * 
+     * @param current : motor current
+     * @param tau : first guess
+     * @return double 
+     */
+    double TorqueIterative(double current, double tau) const
+    {
+      for (int i = 0; i < 100 && fabs(Current(tau) - current) > 1e-12; i++) {
+        tau -= (Current(tau) - current) / Slope(tau);
+      }
+      return tau;
+    }
+
+    double a_;
+    double b_;
+    double c_;
+
+  private:
+    double tau_max_;
+    double i_min_;
+    double step_;
+    double shift_ = 0;            // b / 3a
+    double p_ = 0;                // coefficients of the depressed cubic
+    double q_ = 0;
+    double table_[kTableSize + 1];
+  };
+
   class Actuator
   {
   public:
@@ -49,6 +182,10 @@ namespace gazebo
       it_curve_a_ = it_curve_a;     
       it_curve_b_ = it_curve_b;     
       it_curve_c_ = it_curve_c; 
+      it_curve_.Init(it_curve_a, it_curve_b, it_curve_c, tau_max);
+      for (int i = 0; i < 12; i++) {
+        first_in_[i] = false;
+      }
     }
 
     ~Actuator(){};
@@ -67,7 +204,7 @@ namespace gazebo
       // TN curve
         if ( qd < -n3_ ) {
             tau_act_ = 0;
-            printf( "actuator speed less than min\n" );
+            SIM_LOG_WARN( "actuator speed less than min" );
         }
 
         if ( qd >= -n3_ && qd < -n2_ ) {
@@ -119,7 +256,7 @@ namespace gazebo
 
         if ( qd >= n3_ ) {
             tau_act_ = 0;
-            printf( "actuator speed over max\n" );
+            SIM_LOG_WARN( "actuator speed over max" );
         }
 
       return tau_act_;
@@ -179,20 +316,20 @@ namespace gazebo
      * @brief Get the Actuator Torque
      * 
      * @param I_motor  : motor current
-     * @param tau_last_ : torque at last step
+     * @param tau_last_ : torque at last step, no longer needed as first guess
      * @return double 
      */
     double getActuatorT(double I_motor, double tau_last_){      
-      double k_tau = 3*it_curve_a_*tau_last_*tau_last_+2*it_curve_b_*tau_last_+it_curve_c_;
-      tau_last_ = tau_last_ - (it_curve_a_ * tau_last_ * tau_last_ * tau_last_ + it_curve_b_ * tau_last_ * tau_last_ + it_curve_c_ * tau_last_-I_motor)/k_tau;
-      while(fabs(it_curve_a_ * tau_last_ * tau_last_ * tau_last_ + it_curve_b_ * tau_last_ * tau_last_ + it_curve_c_ * tau_last_-I_motor)>1e-5) {
-          k_tau = 3*it_curve_a_*tau_last_*tau_last_+2*it_curve_b_*tau_last_+it_curve_c_;
-          tau_last_ = tau_last_ - (it_curve_a_ * tau_last_ * tau_last_ * tau_last_ + it_curve_b_ * tau_last_ * tau_last_ + it_curve_c_ * tau_last_-I_motor)/k_tau;
-      }
-              
-      return tau_last_;
+      return it_curve_.Torque(I_motor);
     }
 
+    /**
+     * @brief I-tau curve with the bounded cost inverse
+     * 
+     * @return const ITauCurve& 
+     */
+    const ITauCurve &GetITauCurve() const {return it_curve_;}
+
 
 
   private:
@@ -203,12 +340,177 @@ namespace gazebo
     double it_curve_a_;      // coefficient of I-tau curve
     double it_curve_b_;      // coefficient of I-tau curve
     double it_curve_c_;      // coefficient of I-tau curve
+    ITauCurve it_curve_;
     bool first_in_[12];
     double i_last_[12];
     double tau_last_[12];
     
   };
 
+  /**
+   * @brief Parameters of one actuator, defaults as in Actuator
+   */
+  struct ActuatorParameters
+  {
+    double n1 = 11.52;              // velocity of TN curve
+    double n2 = 29.32;              // velocity of TN curve
+    double n3 = 60.0;               // velocity of TN curve
+    double tau_max = 12.001;        // maximum torque
+    double it_curve_a = 0.0022;     // coefficient of I-tau curve
+    double it_curve_b = -0.0067;    // coefficient of I-tau curve
+    double it_curve_c = 1.1246;     // coefficient of I-tau curve
+    double max_current_step = 3.0;  // current change per call of the current loop
+  };
+
+  /**
+   * @brief Limit violations counted by ActuatorBatch since construction
+   */
+  struct ActuatorCounters
+  {
+    long speed_limit = 0;    // joint faster than n3, no torque
+    long torque_limit = 0;   // desired torque clipped by the TN curve
+    long current_limit = 0;  // current change clipped by the current loop
+  };
+
+  /**
+   * @brief Actuator model of all 12 joints at once, same math as Actuator.
+   *        Joints are in structure of arrays form and every limit is a
+   *        select instead of a branch, so the fixed size expressions
+   *        compile to straight line SIMD code. Limit violations are counted
+   *        instead of printed
+   */
+  class ActuatorBatch
+  {
+  public:
+    typedef Eigen::Array<double, 12, 1, Eigen::DontAlign> Array12d;
+    typedef Eigen::Array<bool, 12, 1, Eigen::DontAlign> Array12b;
+
+    /**
+     * @brief Construct a new ActuatorBatch object with the same parameters for every joint
+     * 
+     * @param parameters 
+     */
+    ActuatorBatch(const ActuatorParameters &parameters = ActuatorParameters())
+    {
+      for (int i = 0; i < 12; i++) {
+        SetParameters(i, parameters);
+      }
+    }
+
+    /**
+     * @brief Set the parameters of one joint
+     * 
+     * @param joint : index of the joint
+     * @param parameters 
+     */
+    void SetParameters(int joint, const ActuatorParameters &parameters)
+    {
+      n2_[joint] = parameters.n2;
+      n3_[joint] = parameters.n3;
+      tau_max_[joint] = parameters.tau_max;
+      slope_[joint] = parameters.tau_max / (parameters.n1 - parameters.n2);
+      it_curve_a_[joint] = parameters.it_curve_a;
+      it_curve_b_[joint] = parameters.it_curve_b;
+      it_curve_c_[joint] = parameters.it_curve_c;
+      max_current_step_[joint] = parameters.max_current_step;
+      it_curve_[joint].Init(parameters.it_curve_a, parameters.it_curve_b, parameters.it_curve_c, parameters.tau_max);
+    }
+
+    /**
+     * @brief Clip desired torques to the TN curve, see Actuator::GetTorque
+     * 
+     * @param tau : desired torque in, actual torque out
+     * @param qd  : actuator velocity
+     */
+    void GetTorque(Array12d &tau, const Array12d &qd)
+    {
+      // Between -n3 and n3 the TN curve is the band [lo, hi], the slopes
+      // meet tau_max at n1 and zero at n2. No torque beyond n3
+      Array12b in_range = (qd >= -n3_) && (qd < n3_);
+      Array12d hi = in_range.select((slope_ * (qd - n2_)).min(tau_max_).max(0.0), 0.0);
+      Array12d lo = in_range.select((slope_ * (qd + n2_)).max(-tau_max_).min(0.0), 0.0);
+      Array12d tau_act = tau.max(lo).min(hi);
+
+      counters_.speed_limit += (!in_range).count();
+      counters_.torque_limit += (in_range && tau_act != tau).count();
+      tau = tau_act;
+    }
+
+    /**
+     * @brief Limit the change of motor current, see Actuator::CerrentLoopResponse
+     * 
+     * @param tau : desired torque in, actual torque out
+     */
+    void CurrentLoopResponse(Array12d &tau)
+    {
+      Array12d current = ((it_curve_a_ * tau + it_curve_b_) * tau + it_curve_c_) * tau;
+      if (first_in_) {
+        first_in_ = false;
+        i_last_ = current;
+        tau_last_ = tau;
+        return;
+      }
+
+      Array12d d_current = current - i_last_;
+      Array12b pass = d_current.abs() < max_current_step_;
+      Array12d current_limited = i_last_ + d_current.max(-max_current_step_).min(max_current_step_);
+      Array12d tau_limited = GetActuatorT(current_limited);
+
+      counters_.current_limit += (!pass).count();
+      tau = pass.select(tau, tau_limited);
+      i_last_ = pass.select(current, current_limited);
+      tau_last_ = tau;
+    }
+
+    /**
+     * @brief Counters of limit violations
+     * 
+     * @return const ActuatorCounters& 
+     */
+    const ActuatorCounters &Counters() const {return counters_;}
+
+    /**
+     * @brief I-tau curve of a joint
+     * 
+     * @param joint : index of the joint
+     * @return const ITauCurve& 
+     */
+    const ITauCurve &GetITauCurve(int joint) const {return it_curve_[joint];}
+
+  private:
+    /**
+     * @brief Invert the I-tau curve, guess of every joint and one Newton
+     *        step for all of them
+     * 
+     * @param current : motor current
+     * @return Array12d 
+     */
+    Array12d GetActuatorT(const Array12d &current) const
+    {
+      Array12d tau;
+      for (int i = 0; i < 12; i++) {
+        tau[i] = it_curve_[i].Guess(current[i]);
+      }
+      Array12d f = ((it_curve_a_ * tau + it_curve_b_) * tau + it_curve_c_) * tau - current;
+      Array12d k_tau = (3 * it_curve_a_ * tau + 2 * it_curve_b_) * tau + it_curve_c_;
+      return tau - f / k_tau;
+    }
+
+    Array12d n2_;
+    Array12d n3_;
+    Array12d tau_max_;
+    Array12d slope_;              // tau_max / (n1 - n2)
+    Array12d it_curve_a_;
+    Array12d it_curve_b_;
+    Array12d it_curve_c_;
+    Array12d max_current_step_;
+    ITauCurve it_curve_[12];
+    Array12d i_last_;
+    Array12d tau_last_;
+    bool first_in_ = true;
+    ActuatorCounters counters_;
+  };
+
 }
 
 #endif //_ACTUATOR_HPP__
\ No newline at end of file
@@ -0,0 +1,259 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ASYNC_LOGGER_HPP__
+#define _ASYNC_LOGGER_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace gazebo
+{
+  enum class LogLevel { kDebug, kInfo, kWarn, kError };
+
+  /**
+   * @brief Parse debug, info, warn or error
+   *
+   * @param name
+   * @param level unchanged if name is not a level
+   * @return false name is not a level
+   */
+  inline bool ParseLogLevel(const std::string &name, LogLevel &level)
+  {
+    static const char *const names[] = {"debug", "info", "warn", "error"};
+    for (int i = 0; i < 4; i++) {
+      if (name == names[i]) {
+        level = LogLevel(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Rate limit of one logging call site, at most kBurst messages per
+   *        wall second, the rest are counted and reported with the next one
+   */
+  class LogSite
+  {
+  public:
+    static constexpr int kBurst = 32;
+
+    /**
+     * @brief Whether the call site may log now
+     *
+     * @param suppressed messages of this site dropped since the last one allowed
+     */
+    bool Allow(long &suppressed)
+    {
+      int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+      int64_t window = window_.load(std::memory_order_relaxed);
+      if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+      }
+      if (count_.fetch_add(1, std::memory_order_relaxed) >= kBurst) {
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+      return true;
+    }
+
+  private:
+    std::atomic<int64_t> window_{0};
+    std::atomic<int> count_{0};
+    std::atomic<long> suppressed_{0};
+  };
+
+  /**
+   * @brief Process wide logger that never blocks its callers. Messages are
+   *        formatted into a preallocated ring shared by all threads and
+   *        written to stdout (debug, info) or stderr (warn, error) by a
+   *        background flusher. When the ring is full messages are dropped
+   *        and counted
+   */
+  class AsyncLogger
+  {
+  public:
+    static constexpr size_t kSlots = 512;
+    static constexpr size_t kMessageSize = 496;
+
+    static AsyncLogger &Instance()
+    {
+      static AsyncLogger logger;
+      return logger;
+    }
+
+    void SetLevel(LogLevel level) {level_.store(level, std::memory_order_relaxed);}
+
+    bool Enabled(LogLevel level) const {return level >= level_.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief Messages dropped because the ring was full
+     *
+     * @return long
+     */
+    long Dropped() const {return dropped_.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief Format a message into the ring, a newline is added when it is written
+     *
+     * @param level
+     * @param suppressed similar messages dropped by the rate limit, noted after the message
+     * @param format printf format
+     */
+    void Log(LogLevel level, long suppressed, const char *format, ...) __attribute__((format(printf, 4, 5)))
+    {
+      // claim a slot, multiple producers race on tail_
+      size_t position = tail_.load(std::memory_order_relaxed);
+      Slot *slot;
+      while (true) {
+        slot = &slots_[position & (kSlots - 1)];
+        intptr_t lag = intptr_t(slot->sequence.load(std::memory_order_acquire)) - intptr_t(position);
+        if (lag == 0) {
+          if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (lag < 0) {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        else {
+          position = tail_.load(std::memory_order_relaxed);
+        }
+      }
+
+      va_list args;
+      va_start(args, format);
+      int length = vsnprintf(slot->text, kMessageSize, format, args);
+      va_end(args);
+      length = std::max(0, std::min(length, int(kMessageSize) - 1));
+      if (suppressed > 0 && length < int(kMessageSize) - 1) {
+        int note = snprintf(slot->text + length, kMessageSize - length, " (%ld similar messages suppressed)", suppressed);
+        length = std::min(length + std::max(0, note), int(kMessageSize) - 1);
+      }
+      slot->level = level;
+      slot->length = length;
+      slot->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Wait until everything logged so far is written
+     *
+     */
+    void Flush()
+    {
+      size_t tail = tail_.load(std::memory_order_acquire);
+      while (head_.load(std::memory_order_acquire) < tail) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+  private:
+    struct Slot
+    {
+      std::atomic<size_t> sequence;
+      LogLevel level;
+      int length;
+      char text[kMessageSize];
+    };
+
+    AsyncLogger()
+    {
+      for (size_t i = 0; i < kSlots; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      flusher_ = std::thread(&AsyncLogger::Run, this);
+    }
+
+    ~AsyncLogger()
+    {
+      running_ = false;
+      flusher_.join();
+      if (Dropped() > 0) {
+        fprintf(stderr, "[Simulation] logger dropped %ld messages\n", Dropped());
+      }
+    }
+
+    /**
+     * @brief Write out every complete message, polled so that producers never make a syscall
+     *
+     */
+    void Run()
+    {
+      while (true) {
+        bool stopping = !running_.load(std::memory_order_acquire);
+        bool wrote_out = false, wrote_err = false;
+        size_t head = head_.load(std::memory_order_relaxed);
+        while (true) {
+          Slot &slot = slots_[head & (kSlots - 1)];
+          if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            break;
+          }
+          FILE *stream = slot.level >= LogLevel::kWarn ? stderr : stdout;
+          fwrite(slot.text, 1, slot.length, stream);
+          fputc('\n', stream);
+          (stream == stderr ? wrote_err : wrote_out) = true;
+          slot.sequence.store(head + kSlots, std::memory_order_release);
+          head_.store(++head, std::memory_order_release);
+        }
+        if (wrote_out) {
+          fflush(stdout);
+        }
+        if (wrote_err) {
+          fflush(stderr);
+        }
+        if (stopping) {
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+
+    std::atomic<LogLevel> level_{LogLevel::kInfo};
+    std::atomic<size_t> tail_{0};
+    std::atomic<size_t> head_{0};
+    std::atomic<long> dropped_{0};
+    std::atomic<bool> running_{true};
+    std::thread flusher_;
+    Slot slots_[kSlots];
+  };
+}
+
+/**
+ * @brief Log through the AsyncLogger with the rate limit of this call site
+ */
+#define SIM_LOG(level, ...)                                                                   \
+  do {                                                                                        \
+    static ::gazebo::LogSite sim_log_site_;                                                   \
+    long sim_log_suppressed_ = 0;                                                             \
+    if (::gazebo::AsyncLogger::Instance().Enabled(level) && sim_log_site_.Allow(sim_log_suppressed_)) { \
+      ::gazebo::AsyncLogger::Instance().Log(level, sim_log_suppressed_, __VA_ARGS__);         \
+    }                                                                                         \
+  } while (0)
+
+#define SIM_LOG_DEBUG(...) SIM_LOG(::gazebo::LogLevel::kDebug, __VA_ARGS__)
+#define SIM_LOG_INFO(...) SIM_LOG(::gazebo::LogLevel::kInfo, __VA_ARGS__)
+#define SIM_LOG_WARN(...) SIM_LOG(::gazebo::LogLevel::kWarn, __VA_ARGS__)
+#define SIM_LOG_ERROR(...) SIM_LOG(::gazebo::LogLevel::kError, __VA_ARGS__)
+
+#endif //_ASYNC_LOGGER_HPP__
@@ -0,0 +1,149 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _BATCH_SIMULATOR_HPP__
+#define _BATCH_SIMULATOR_HPP__
+
+#include <memory>
+#include <vector>
+
+#include "actuator.hpp"
+#include "rigid_body_dynamics.hpp"
+#include "sim_utilities/spine_board.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace gazebo
+{
+  /**
+   * @brief Joint PD commands of every environment, one array per field,
+   *        [env * 12 + joint] with joints in control program order and sign.
+   *        They go through the spine boards as a SpiCommand with every board
+   *        enabled, so torque limits and softstops apply as in LeggedPlugin
+   */
+  struct BatchCommand
+  {
+    std::vector<double> q_des;
+    std::vector<double> qd_des;
+    std::vector<double> kp;
+    std::vector<double> kd;
+    std::vector<double> tau_ff;
+  };
+
+  /**
+   * @brief State of every environment after a step, one array per field
+   */
+  struct BatchState
+  {
+    std::vector<double> time;                   // [env]
+    std::vector<double> q;                      // [env * 12 + joint], control program order and sign
+    std::vector<double> qd;
+    std::vector<double> tau;                    // actuator torque of the last physics step
+    std::vector<double> base_position;          // [env * 3 + axis], world
+    std::vector<double> base_orientation;       // [env * 4 + i], w x y z, base to world
+    std::vector<double> base_linear_velocity;   // [env * 3 + axis], base coordinates
+    std::vector<double> base_angular_velocity;  // [env * 3 + axis], base coordinates
+    std::vector<double> foot_force;             // [env * 12 + leg * 3 + axis], world, zero for a leg without foot contact
+  };
+
+  /**
+   * @brief Independent quadrupeds stepped together on a work stealing pool.
+   *        Every environment has its own dynamics, contact and actuator
+   *        state and shares the model. Commands are read from and states
+   *        gathered into contiguous arrays, environments never touch each
+   *        other's data, so the result does not depend on the thread count
+   */
+  class BatchSimulator
+  {
+  public:
+    /**
+     * @brief Construct the environments, all reset at the origin
+     *
+     * @param model shared by every environment, must outlive the simulator
+     * @param envs number of environments
+     * @param threads threads stepping them, the caller included
+     * @param contact
+     */
+    BatchSimulator(const RigidBodyModel &model, int envs, int threads,
+                   const ContactParameters &contact = ContactParameters());
+
+    int Envs() const {return int(envs_.size());}
+    int Threads() const {return pool_.Threads();}
+    uint64_t Steals() const {return pool_.Steals();}
+
+    /**
+     * @brief Environments per chunk of work, smaller balances better, larger
+     *        costs less queueing. Default 1
+     */
+    void SetGrain(int grain) {grain_ = std::max(1, grain);}
+
+    /**
+     * @brief Put an environment at rest, clear its actuator state and zero its command
+     *
+     * @param env
+     * @param position base in the world
+     * @param orientation base to world
+     * @param q joint angles in control program order and sign, nullptr for all zero
+     */
+    void Reset(int env, const SpatialVec3 &position, const Eigen::Quaterniond &orientation, const double *q = nullptr);
+
+    /**
+     * @brief Commands applied by the next Step, written by the caller between steps
+     */
+    BatchCommand &Command() {return command_;}
+
+    /**
+     * @brief State gathered at the end of the last Step or Reset
+     */
+    const BatchState &State() const {return state_;}
+
+    /**
+     * @brief Advance every environment by steps physics steps of dt, the
+     *        command held and the spine boards and actuator model run every step
+     *
+     * @param steps
+     * @param dt
+     */
+    void Step(int steps, double dt);
+
+  private:
+    struct Environment
+    {
+      explicit Environment(const RigidBodyModel &model, const ContactParameters &contact)
+      : dynamics(model, contact) {}
+
+      RigidBodyDynamics dynamics;
+      ActuatorBatch motor;
+      SpiCommand cmd;
+      SpiData spi_data;
+      SpineBoard spine_board;
+      double tau[RigidBodyModel::kMaxBodies] = {};
+    };
+
+    void StepEnvironment(int env, int steps, double dt);
+
+    /**
+     * @brief Copy the state of an environment into its slots of state_
+     */
+    void Gather(int env);
+
+    const RigidBodyModel &model_;
+    // one allocation per environment, threads stepping neighbours do not share lines
+    std::vector<std::unique_ptr<Environment>> envs_;
+    BatchCommand command_;
+    BatchState state_;
+    WorkStealingPool pool_;
+    int grain_ = 1;
+  };
+}
+
+#endif //_BATCH_SIMULATOR_HPP__
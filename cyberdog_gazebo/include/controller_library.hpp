@@ -0,0 +1,91 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _CONTROLLER_LIBRARY_HPP__
+#define _CONTROLLER_LIBRARY_HPP__
+
+#include <string>
+
+#include "sim_utilities/controller_library_interface.hpp"
+
+namespace gazebo
+{
+    /**
+     * @brief Control program loaded into the simulator process through the
+     *        C ABI of controller_library_interface.hpp, it answers the
+     *        SimulatorMessage in place of a control program on the other
+     *        side of the sharedmemory
+     */
+    class ControllerLibrary
+    {
+    public:
+        ~ControllerLibrary();
+
+        /**
+         * @brief dlopen the library and create its controller
+         * 
+         * @param path shared library, searched like dlopen does if it has no slash
+         * @param args passed to sim_controller_init
+         * @param message message the controller answers
+         * @param error why loading failed
+         * @return true the controller is ready
+         * @return false the library is not loaded
+         */
+        bool Load(const std::string &path, const std::string &args, SimulatorMessage &message, std::string &error);
+
+        /**
+         * @brief Shut the controller down and create a new one with the same arguments
+         * 
+         * @param message message the controller answers
+         * @return true the new controller is ready
+         * @return false sim_controller_init failed
+         */
+        bool Restart(SimulatorMessage &message);
+
+        /**
+         * @brief Shut the controller down and dlclose the library
+         * 
+         */
+        void Unload();
+
+        /**
+         * @brief Answer the message for its simToRobot.mode, what a control
+         *        program does between WaitForSimulator and RobotIsDone
+         * 
+         * @param message 
+         * @param table parameters of a kSET_ALL_PARAMS request, nullptr if there is no table
+         * @return true answered
+         * @return false the controller returned an error
+         */
+        bool Run(SimulatorMessage &message, ControlParameterTable *table);
+
+        bool Loaded() const {return controller_ != nullptr;}
+
+    private:
+        typedef u32 (*AbiVersionFunction)(void);
+        typedef void *(*InitFunction)(const char *, u64, SimulatorMessage *);
+        typedef s32 (*HandleParameterFunction)(void *, SimulatorMessage *, ControlParameterTable *);
+        typedef s32 (*StepFunction)(void *, const SimulatorToRobotMessage *, RobotToSimulatorMessage *);
+        typedef void (*ShutdownFunction)(void *);
+
+        void *handle_ = nullptr;
+        void *controller_ = nullptr;
+        std::string args_;
+        InitFunction init_ = nullptr;
+        HandleParameterFunction handle_parameter_ = nullptr;
+        StepFunction step_ = nullptr;
+        ShutdownFunction shutdown_ = nullptr;
+    };
+}
+
+#endif //_CONTROLLER_LIBRARY_HPP__
@@ -0,0 +1,81 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _CONTROLLER_STAND_IN_HPP__
+#define _CONTROLLER_STAND_IN_HPP__
+
+#include "sim_utilities/simulator_message.hpp"
+
+namespace gazebo
+{
+    enum class StandInMode { STAND, TROT };
+
+    struct StandInConfig
+    {
+        StandInMode mode = StandInMode::STAND;
+        float kp = 60.f;                              // joint stiffness
+        float kd = 1.5f;                              // joint damping
+        float q_stand[3] = {0.f, -0.75f, 1.5f};       // abad, hip, knee in control program convention
+        float ramp_time = 1.f;                        // time to move from the initial pose to q_stand
+        float trot_frequency = 2.f;                   // gait cycles per second
+        float trot_amplitude = 0.3f;                  // knee flexion at the top of a swing
+        float dt = 0.002f;                            // control period
+        long compute_delay_ns = 0;                    // synthetic controller computation per tick
+    };
+
+    /**
+     * @brief Minimal control program speaking the SimulatorMessage protocol.
+     *        Acknowledges control parameters and holds a joint space PD stand
+     *        or trots in place, as deterministic load for the simulator
+     */
+    class StandInController
+    {
+    public:
+        /**
+         * @brief Construct a new StandInController object
+         *
+         * @param config gains, pose and gait of the stand-in
+         */
+        StandInController(const StandInConfig &config);
+
+        /**
+         * @brief Acknowledge the pending control parameter request
+         *
+         * @param msg sharedmemory message holding request and response
+         * @param table parameters of a kSET_ALL_PARAMS request, nullptr if not attached
+         */
+        void HandleControlParameters(SimulatorMessage &msg, ControlParameterTable *table);
+
+        /**
+         * @brief Compute one tick of joint commands
+         *
+         * @param sim state from simulator
+         * @param cmd joint commands to simulator
+         */
+        void RunController(const SimulatorToRobotMessage &sim, SpiCommand &cmd);
+
+        /**
+         * @brief Number of RUN_CONTROLLER ticks computed so far
+         *
+         * @return long
+         */
+        long Iterations() const {return iterations_;}
+
+    private:
+        StandInConfig config_;
+        long iterations_ = 0;
+        float q_init_[4][3];
+    };
+}
+
+#endif //_CONTROLLER_STAND_IN_HPP__
@@ -24,11 +24,49 @@ enum class ControlParameterRequestKind {
     kGET_SPEED_CALIBRATE_PARAM_BY_NAME,
     kSET_SPEED_CALIBRATE_PARAM_BY_NAME,
     kGET_IMU_CALIBRATE_PARAM_BY_NAME,
-    kSET_IMU_CALIBRATE_PARAM_BY_NAME
+    kSET_IMU_CALIBRATE_PARAM_BY_NAME,
+    kSET_ALL_PARAMS  // set every entry of the ControlParameterTable at once
 };
 
 std::string ControlParameterRequestKindToString( ControlParameterRequestKind request );
 
+// maximum number of parameters committed by one kSET_ALL_PARAMS request
+#define kCONTROL_PARAMETER_TABLE_SIZE 1024
+
+// written by the robot into RobotToSimulatorMessage::controlParameterTableSupport when it handles kSET_ALL_PARAMS
+#define kCONTROL_PARAMETER_TABLE_MAGIC 0x5441424C45504152ull
+
+/*!
+ * Result of setting one entry of a ControlParameterTable
+ */
+enum class ControlParameterStatus : s32 {
+    kPENDING      = 0,  // not handled by the robot
+    kOK           = 1,
+    kNOT_FOUND    = 2,  // no parameter with this name
+    kKIND_MISMATCH = 3  // parameter exists with another value kind
+};
+
+/*!
+ * One parameter of a ControlParameterTable
+ */
+struct ControlParameterTableEntry {
+    char                      name[ kCONTROL_PARAMETER_MAXIMUM_NAME_LENGTH ];
+    ControlParameterValue     value;
+    ControlParameterValueKind parameterKind;
+    s32                       isUser;  // user parameter if nonzero, robot parameter otherwise
+    ControlParameterStatus    status;  // written by the robot
+};
+
+/*!
+ * Parameters uploaded in a single kSET_ALL_PARAMS transaction, so connecting
+ * to the robot doesn't cost one simulator/robot round trip per parameter.
+ * It has its own shared memory object, only created when a robot supports it
+ */
+struct ControlParameterTable {
+    u64                        count;
+    ControlParameterTableEntry entries[ kCONTROL_PARAMETER_TABLE_SIZE ];
+};
+
 /*!
  * Data sent to a control parameter collection to request a get/set of a value
  */
@@ -79,6 +117,8 @@ struct ControlParameterRequest {
             result += "imu_calibrate to: ";
             result += ControlParameterValueToString( value, parameterKind );
             return result;
+        case ControlParameterRequestKind::kSET_ALL_PARAMS:
+            return result + "from parameter table";
         default:
             return result + " unknown request type!";
         }
@@ -146,6 +186,8 @@ struct ControlParameterResponse {
             result += "imu_calibrate to: ";
             result += ControlParameterValueToString( value, parameterKind );
             return result;
+        case ControlParameterRequestKind::kSET_ALL_PARAMS:
+            return result + std::to_string( nParameters ) + " parameters from table";
         default:
             return result + " unknown request type!";
         }
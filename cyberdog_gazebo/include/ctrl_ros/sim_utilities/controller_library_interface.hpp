@@ -0,0 +1,65 @@
+/*! @file controller_library_interface.hpp
+ *  @brief C ABI of a control program built as a shared library
+ *
+ *  Instead of attaching to the development-simulator shared memory from its
+ *  own process, a control program may be loaded into the simulator with
+ *  dlopen and called from the physics thread on the same SimulatorMessage.
+ *  The library exports the functions declared here with C linkage. Every
+ *  call is made from one thread, one call at a time.
+ */
+
+#ifndef CONTROLLER_LIBRARY_INTERFACE_H
+#define CONTROLLER_LIBRARY_INTERFACE_H
+
+#include "sim_utilities/simulator_message.hpp"
+
+/*!
+ * Bumped whenever a function below changes. The size of SimulatorMessage is
+ * checked separately, it differs between the compact and legacy layouts.
+ */
+#define SIM_CONTROLLER_ABI_VERSION 2
+
+extern "C" {
+
+/*!
+ * @return SIM_CONTROLLER_ABI_VERSION the library was built with
+ */
+u32 sim_controller_abi_version( void );
+
+/*!
+ * Create the controller
+ * @param args : free form arguments from the simulator configuration
+ * @param message_size : sizeof( SimulatorMessage ) in the simulator, the
+ *                       library must fail if its own differs
+ * @param message : the message the controller will be called with. Like a
+ *                  control program attaching to the shared memory, the library
+ *                  marks robotToSim.controlParameterTableSupport here if it
+ *                  handles kSET_ALL_PARAMS
+ * @return the controller passed to the other functions, nullptr on failure
+ */
+void* sim_controller_init( const char* args, u64 message_size, SimulatorMessage* message );
+
+/*!
+ * Answer the control parameter request in message->simToRobot, like a
+ * control program does in RUN_CONTROL_PARAMETERS mode
+ * @param table : parameters of a kSET_ALL_PARAMS request, nullptr until the
+ *                simulator has created the table and always with the legacy
+ *                layout
+ * @return 0, or non-zero after writing message->robotToSim.errorMessage
+ */
+s32 sim_controller_handle_parameter( void* controller, SimulatorMessage* message, ControlParameterTable* table );
+
+/*!
+ * Compute one control tick, like a control program does in RUN_CONTROLLER mode
+ * @return 0, or non-zero after writing robot_to_sim->errorMessage
+ */
+s32 sim_controller_step( void* controller, const SimulatorToRobotMessage* sim_to_robot, RobotToSimulatorMessage* robot_to_sim );
+
+/*!
+ * Destroy the controller, it is not called again afterwards
+ */
+void sim_controller_shutdown( void* controller );
+
+}
+
+#endif  // CONTROLLER_LIBRARY_INTERFACE_H
@@ -16,6 +16,23 @@
 #include "sim_utilities/visualization_data.hpp"
 #include "utilities/shared_memory.hpp"
 
+#define DEVELOPMENT_SIMULATOR_VISUALIZATION_SHARED_MEMORY_NAME "development-simulator-visualization"
+#define DEVELOPMENT_SIMULATOR_STATS_SHARED_MEMORY_NAME "development-simulator-stats"
+#define DEVELOPMENT_SIMULATOR_PARAMETER_TABLE_SHARED_MEMORY_NAME "development-simulator-parameter-table"
+
+/*
+ * Without SIMULATOR_MESSAGE_LEGACY_LAYOUT the visualization data and the
+ * control parameter table live in their own shared memory objects and the
+ * control messages are cache-line aligned, so the segment touched every tick
+ * is a few kilobytes instead of megabytes.
+ * Define it to talk to control programs built against the old layout.
+ */
+#ifdef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+#define SIMULATOR_MESSAGE_ALIGN
+#else
+#define SIMULATOR_MESSAGE_ALIGN alignas( 64 )
+#endif
+
 /*!
  * The mode for the simulator
  */
@@ -31,27 +48,38 @@ enum class SimulatorMode {
  * A plain message from the simulator to the robot
  */
 struct SimulatorToRobotMessage {
-  int value0[2];//value*: tmp for struct 8bytes alignment
-  
-  int value1;
-  
-  int value2;
+  // the former value0..value2 alignment padding, same size and offsets:
+  // CLOCK_MONOTONIC ns when the tick was handed to the robot, its sequence
+  // number and the time the robot has for it in us
+  s64 tickSendTime;
+  s32 tickSequence;
+  s32 tickDeadline;
   GamepadCommand gamepadCommand;// joystick
   RobotType robotType;// which robot the simulator thinks we are simulating
   
   
   // imu data
-  VectorNavData vectorNav;
+  SIMULATOR_MESSAGE_ALIGN VectorNavData vectorNav;
   CheaterState<double> cheaterState;
 
   // leg data
-  SpiData spiData;
+  SIMULATOR_MESSAGE_ALIGN SpiData spiData;
   // TODO: remove tiboard related later
   // TiBoardData tiBoardData[4];
   ControlParameterRequest controlParameterRequest;
 
   SimulatorMode mode;
   //int value2;
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+  // set once the simulator has created the visualization shared memory
+  int32_t visualizationEnabled;
+  // set once the simulator has created the control parameter table shared memory
+  int32_t controlParameterTableEnabled;
+  // SCHED_FIFO priority, 0 for none, and cpus (bit i for cpu i, 0 for any)
+  // the simulator recommends for the control program, away from its own
+  int32_t controllerPriority;
+  u64 controllerAffinity;
+#endif
 };
 
 /*!
@@ -60,12 +88,23 @@ struct SimulatorToRobotMessage {
 struct RobotToSimulatorMessage {
   
   RobotType robotType;
-  SpiCommand spiCommand;
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+  // optional, in the padding before spiCommand: the tickSequence being
+  // answered and CLOCK_MONOTONIC ns when the robot started and finished it
+  s32 tickSequence;
+  s64 tickStartTime;
+  s64 tickEndTime;
+  // kCONTROL_PARAMETER_TABLE_MAGIC once the robot attached, if it handles kSET_ALL_PARAMS
+  u64 controlParameterTableSupport;
+#endif
+  SIMULATOR_MESSAGE_ALIGN SpiCommand spiCommand;
   // TiBoardCommand tiBoardCommand[4];
 
+#ifdef SIMULATOR_MESSAGE_LEGACY_LAYOUT
   VisualizationData visualizationData;
   CheetahVisualization mainCheetahVisualization;
-  ControlParameterResponse controlParameterResponse;
+#endif
+  SIMULATOR_MESSAGE_ALIGN ControlParameterResponse controlParameterResponse;
 
   char errorMessage[2056];
 };
@@ -74,8 +113,74 @@ struct RobotToSimulatorMessage {
  * All the data shared between the robot and the simulator
  */
 struct SimulatorMessage {
-  RobotToSimulatorMessage robotToSim;
-  SimulatorToRobotMessage simToRobot;
+  SIMULATOR_MESSAGE_ALIGN RobotToSimulatorMessage robotToSim;
+  SIMULATOR_MESSAGE_ALIGN SimulatorToRobotMessage simToRobot;
+};
+
+/*!
+ * Controller timing measured by the simulator, all times in ns
+ */
+struct ControllerTiming {
+  u64 ticks;            // control ticks answered
+  u64 deadlineMisses;   // ticks whose round trip exceeded deadlineNs
+  u64 staleReplies;     // robot answered with another tickSequence
+  u64 deadlineNs;
+  u64 lastNs;           // round trip of the latest tick
+  u64 minNs;
+  u64 maxNs;
+  double avgNs;
+  u64 p50Ns;            // quantiles refreshed every 256 ticks
+  u64 p99Ns;
+  u64 p999Ns;
+  u64 stampedTicks;     // ticks the robot stamped, the averages below use only these
+  double avgWakeNs;     // tickSendTime to tickStartTime
+  double avgComputeNs;  // tickStartTime to tickEndTime
+  double avgReturnNs;   // tickEndTime to the simulator noticing the answer
+};
+
+/*!
+ * ControllerTiming in its own shared memory object so tools can read it
+ * while the simulation runs. The simulator updates it once per control tick,
+ * sequence is odd while an update is in progress
+ */
+struct ControllerTimingStats {
+  std::atomic<u64> sequence;
+  ControllerTiming timing;
+
+  /*!
+   * Consistent copy of timing, retried until no update overlapped it
+   */
+  ControllerTiming Read() const {
+    ControllerTiming copy;
+    u64 before, after;
+    do {
+      before = sequence.load( std::memory_order_acquire );
+      memcpy( &copy, &timing, sizeof( copy ) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      after = sequence.load( std::memory_order_relaxed );
+    } while ( ( before & 1 ) || before != after );
+    return copy;
+  }
+};
+
+/*!
+ * Clock of the tick timestamps, comparable between simulator and robot
+ * processes on the same host
+ */
+inline s64 MonotonicNanoseconds() {
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return s64( now.tv_sec ) * 1000000000 + now.tv_nsec;
+}
+
+/*!
+ * Debugging data from the robot to the simulator GUI. With the compact layout
+ * it has its own shared memory object, created only when a consumer asks for
+ * it, the robot attaches once simToRobot.visualizationEnabled is set.
+ */
+struct VisualizationMessage {
+  VisualizationData visualizationData;
+  CheetahVisualization mainCheetahVisualization;
 };
 
 #endif  // PROJECT_SIMULATORTOROBOTMESSAGE_H
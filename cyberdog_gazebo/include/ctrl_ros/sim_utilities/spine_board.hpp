@@ -68,25 +68,26 @@ struct SpiData {
 };
 
 /*!
- * Spine board control logic
+ * Spine board control logic of all four boards at once. The boards are the
+ * lanes of the [4] arrays of SpiCommand and SpiData, softstops and torque
+ * limits are selects rather than branches so a joint of every board is
+ * computed together
  */
 class SpineBoard {
  public:
   SpineBoard() {}
-  void init(float side_sign, s32 board);
   void run();
   void resetData();
   void resetCommand();
   SpiCommand* cmd = nullptr;
   SpiData* data = nullptr;
-  float torque_out[3];
+  float torque_out[3][4];  // abad, hip, knee torque of each board
 
  private:
-  float side_sign;
-  s32 board_num;
   const float max_torque[3] = {17.f, 24.f, 26.f};  // TODO CHECK WITH BEN
   const float wimp_torque[3] = {6.f, 6.f, 6.f};    // TODO CHECK WITH BEN
   const float disabled_torque[3] = {0.f, 0.f, 0.f};
+  const bool has_softstop[3] = {true, true, false};
   const float q_limit_p[3] = {1.5f, 5.0f, 0.f};
   const float q_limit_n[3] = {-1.5f, -5.0f, 0.f};
   const float kp_softstop = 100.f;
@@ -7,7 +7,9 @@
 #ifndef PROJECT_SHAREDMEMORY_H
 #define PROJECT_SHAREDMEMORY_H
 
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <semaphore.h>
@@ -15,13 +17,243 @@
 #include <string>
 #include <sys/errno.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/magic.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#endif
 
 #include "c_types.h"
 
 #define DEVELOPMENT_SIMULATOR_SHARED_MEMORY_NAME "development-simulator"
 
+// environment variable selecting the simulator instance when several share a host
+#define SIMULATOR_INSTANCE_ENV "CYBERDOG_SIM_INSTANCE"
+
+/*!
+ * Scope a shared resource name to one simulator instance. Instance 0 keeps the
+ * plain name, so a single simulator still works with unmodified controllers.
+ */
+inline std::string InstanceScopedName( const std::string& name, int instance ) {
+    return instance > 0 ? name + "-" + std::to_string( instance ) : name;
+}
+
+/*!
+ * Simulator instance taken from the environment, 0 if it is not set
+ */
+inline int SimulatorInstanceFromEnv() {
+    const char* value = getenv( SIMULATOR_INSTANCE_ENV );
+    return value ? atoi( value ) : 0;
+}
+
+// hugetlbfs mount used for SharedMemoryBacking::kHugetlbfs segments
+#ifndef SHARED_MEMORY_HUGETLBFS_PATH
+#define SHARED_MEMORY_HUGETLBFS_PATH "/dev/hugepages/"
+#endif
+
+// number of busy-wait polls before a seqlock waiter parks in the kernel
+#ifndef SHARED_MEMORY_SEQLOCK_SPIN_COUNT
+#define SHARED_MEMORY_SEQLOCK_SPIN_COUNT 4000
+#endif
+
+/*!
+ * How the simulator and the robot hand the shared object back and forth.
+ *
+ * kSemaphore uses the two named POSIX semaphores and is understood by every
+ * controller build. kSeqlock uses generation counters stored next to the
+ * object in the shared segment: the waiter spins for a bounded number of polls
+ * and only then parks on a futex, so a fast peer is picked up without any
+ * syscall or context switch. Both processes must be built with this header
+ * to use kSeqlock.
+ */
+enum class SharedMemorySyncMode : u32 { kSemaphore = 0, kSeqlock = 1 };
+
+/*!
+ * Pages backing a shared memory object.
+ *
+ * kTransparentHugePages keeps the POSIX shm file and asks the kernel to back
+ * it with transparent huge pages (needs shmem_enabled=advise or always).
+ * kHugetlbfs puts the file on SHARED_MEMORY_HUGETLBFS_PATH, which needs
+ * reserved huge pages. Both fall back to normal pages when unavailable.
+ */
+enum class SharedMemoryBacking { kDefault, kTransparentHugePages, kHugetlbfs };
+
+/*!
+ * Options used when a shared memory object is created or attached
+ */
+struct SharedMemoryOptions {
+    bool                populate = false;  // prefault the whole mapping with MAP_POPULATE
+    bool                lock     = false;  // mlock the mapping so it is never reclaimed
+    SharedMemoryBacking backing  = SharedMemoryBacking::kDefault;
+};
+
+static_assert( ATOMIC_INT_LOCK_FREE == 2, "seqlock sync needs address-free atomics" );
+
+/*!
+ * One direction of the seqlock handshake. The producer bumps the generation
+ * counter, the consumer owns the consumed counter, so the pair behaves like a
+ * counting semaphore whose state lives in the shared segment.
+ */
+struct alignas( 64 ) SharedMemorySyncChannel {
+    std::atomic< u32 > generation;
+    std::atomic< u32 > waiters;
+    std::atomic< u32 > consumed;
+};
+
+/*!
+ * Control block placed right after the shared object
+ */
+struct alignas( 64 ) SharedMemorySyncBlock {
+    std::atomic< u32 >      mode;
+    SharedMemorySyncChannel robot_to_sim;
+    SharedMemorySyncChannel sim_to_robot;
+};
+
+/*!
+ * Waiting side of a SharedMemorySyncChannel: spin-then-park with an optional
+ * deadline. Same semantics as SharedMemorySemaphore but without a syscall on
+ * the fast path.
+ */
+class SharedMemorySeqlock {
+public:
+    void Init( SharedMemorySyncChannel* channel ) {
+        channel_ = channel;
+        // spinning only pays off if the peer can run at the same time
+        spin_count_ = sysconf( _SC_NPROCESSORS_ONLN ) > 1 ? SHARED_MEMORY_SEQLOCK_SPIN_COUNT : 0;
+    }
+
+    /*!
+     * Publish one generation and wake the peer if it is parked
+     */
+    void Increment() {
+        // seq_cst pairs with the waiter's increment of waiters before it parks
+        channel_->generation.fetch_add( 1, std::memory_order_seq_cst );
+        if ( channel_->waiters.load( std::memory_order_seq_cst ) ) {
+            Wake();
+        }
+    }
+
+    /*!
+     * Wait until a generation is published, then consume it
+     */
+    void Decrement() {
+        Wait( nullptr );
+    }
+
+    /*!
+     * Consume a generation if one is available, never waits
+     */
+    bool TryDecrement() {
+        u32 consumed = channel_->consumed.load( std::memory_order_relaxed );
+        if ( channel_->generation.load( std::memory_order_acquire ) == consumed ) {
+            return false;
+        }
+        channel_->consumed.store( consumed + 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    /*!
+     * Generations published but not consumed yet, read without consuming
+     */
+    u32 Pending() const {
+        return channel_->generation.load( std::memory_order_acquire ) - channel_->consumed.load( std::memory_order_acquire );
+    }
+
+    /*!
+     * Like Decrement, but gives up after the given time
+     * Returns true if a generation was consumed
+     */
+    bool DecrementTimeout( u64 seconds, u64 nanoseconds ) {
+        struct timespec deadline;
+        clock_gettime( CLOCK_MONOTONIC, &deadline );
+        deadline.tv_nsec += nanoseconds;
+        deadline.tv_sec += seconds;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        return Wait( &deadline );
+    }
+
+private:
+    bool Wait( const struct timespec* deadline ) {
+        for ( int i = 0; i < spin_count_; i++ ) {
+            if ( TryDecrement() ) {
+                return true;
+            }
+            CpuRelax();
+        }
+
+        while ( !TryDecrement() ) {
+            u32 seen = channel_->generation.load( std::memory_order_acquire );
+            if ( seen != channel_->consumed.load( std::memory_order_relaxed ) ) {
+                continue;
+            }
+            channel_->waiters.fetch_add( 1, std::memory_order_seq_cst );
+            bool timed_out = !Park( seen, deadline );
+            channel_->waiters.fetch_sub( 1, std::memory_order_relaxed );
+            if ( timed_out ) {
+                return TryDecrement();
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * Sleep while the generation still equals seen
+     * @return false once the deadline has passed
+     */
+    bool Park( u32 seen, const struct timespec* deadline ) {
+        struct timespec  remaining;
+        struct timespec* timeout = nullptr;
+        if ( deadline ) {
+            struct timespec now;
+            clock_gettime( CLOCK_MONOTONIC, &now );
+            remaining.tv_sec  = deadline->tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+            if ( remaining.tv_nsec < 0 ) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000;
+            }
+            if ( remaining.tv_sec < 0 ) {
+                return false;
+            }
+            timeout = &remaining;
+        }
+#ifdef __linux__
+        // not FUTEX_PRIVATE_FLAG: the word is shared with another process
+        if ( syscall( SYS_futex, &channel_->generation, FUTEX_WAIT, seen, timeout, nullptr, 0 ) == -1 && errno == ETIMEDOUT ) {
+            return false;
+        }
+#else
+        ( void )seen;
+        ( void )timeout;
+        usleep( 50 );
+#endif
+        return true;
+    }
+
+    void Wake() {
+#ifdef __linux__
+        syscall( SYS_futex, &channel_->generation, FUTEX_WAKE, 1, nullptr, nullptr, 0 );
+#endif
+    }
+
+    static inline void CpuRelax() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+        __builtin_ia32_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+        asm volatile( "yield" );
+#endif
+    }
+
+    SharedMemorySyncChannel* channel_    = nullptr;
+    int                      spin_count_ = SHARED_MEMORY_SEQLOCK_SPIN_COUNT;
+};
+
 /*!
  * A POSIX semaphore for shared memory.
  * See https://linux.die.net/man/7/sem_overview for more deatils
@@ -82,6 +314,15 @@ public:
         return ( sem_trywait( _sem ) ) == 0;
     }
 
+    /*!
+     * Current value of the semaphore, read without decrementing it
+     */
+    int Value() {
+        int value = 0;
+        sem_getvalue( _sem, &value );
+        return value > 0 ? value : 0;
+    }
+
     /*!
      * Like decrement, but after waiting ms milliseconds, will give up
      * Returns true if the semaphore is successfully decremented
@@ -126,12 +367,21 @@ private:
  * Viewing an existing object allocated with CreateNew can be done with
  * Attach/Detach
  *
+ * The segment also carries a SharedMemorySyncBlock after the object, used when
+ * Init() selects SharedMemorySyncMode::kSeqlock.
+ *
  * For an example, see test_sharedMemory.cpp
  */
 template < typename T > class SharedMemoryObject {
 public:
     SharedMemoryObject() = default;
 
+    /*!
+     * Offset of the sync block, cache-line aligned so it never shares a line
+     * with the tail of the object
+     */
+    static constexpr size_t kSyncBlockOffset = ( sizeof( T ) + 63 ) & ~size_t( 63 );
+
     /*!
      * Allocate memory for the shared memory object and Attach to it.
      * If allowOverwrite is true, and there's already an object with this name,
@@ -141,18 +391,30 @@ public:
      * Otherwise, if an object with the name already exists, throws a
      * std::runtime_error
      */
-    bool CreateNew( const std::string& name, bool allowOverwrite = false ) {
+    bool CreateNew( const std::string& name, bool allowOverwrite = false, const SharedMemoryOptions& options = SharedMemoryOptions() ) {
         bool hadToDelete = false;
         assert( !data_ );
         name_ = name;
-        size_ = sizeof( T )+16;
+        size_ = kSyncBlockOffset + sizeof( SharedMemorySyncBlock );
         printf( "[Shared Memory] open new %s, size %ld bytes\n", name.c_str(), size_ );
+        long faults = PageFaults();
 
         if ( shm_unlink( name.c_str() ) ) {
             printf( "[Shared Memory] Error in shm_unlink: %s\n", strerror( errno ) );
         }
 
-        fd_ = shm_open( name.c_str(), O_RDWR | O_CREAT, S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP | S_IROTH );
+        fd_ = -1;
+        if ( options.backing == SharedMemoryBacking::kHugetlbfs ) {
+            unlink( HugetlbfsPath().c_str() );
+            fd_ = open( HugetlbfsPath().c_str(), O_RDWR | O_CREAT, S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP | S_IROTH );
+            if ( fd_ == -1 ) {
+                printf( "[Shared Memory] hugetlbfs unavailable for %s (%s), using normal pages\n", name.c_str(), strerror( errno ) );
+            }
+        }
+        hugetlbfs_ = fd_ != -1;
+        if ( !hugetlbfs_ ) {
+            fd_ = shm_open( name.c_str(), O_RDWR | O_CREAT, S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP | S_IROTH );
+        }
         if ( fd_ == -1 ) {
             printf( "[ERROR] SharedMemoryObject shm_open failed: %s\n", strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
@@ -178,13 +440,25 @@ public:
             // return false;
         }
 
+        // huge pages can only be mapped in whole pages
+        size_ = RoundToPage( size_ );
+
         if ( ftruncate( fd_, size_ ) ) {
             printf( "[ERROR] SharedMemoryObject::CreateNew(%s) ftruncate(%ld): %s\n", name.c_str(), size_, strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
             return false;
         }
 
-        void* mem = mmap( nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0 );
+        void* mem = Map( options );
+        if ( mem == MAP_FAILED && hugetlbfs_ ) {
+            // no huge pages reserved, start over on normal pages
+            printf( "[Shared Memory] no huge pages left for %s (%s), using normal pages\n", name.c_str(), strerror( errno ) );
+            close( fd_ );
+            unlink( HugetlbfsPath().c_str() );
+            SharedMemoryOptions fallback = options;
+            fallback.backing             = SharedMemoryBacking::kDefault;
+            return CreateNew( name, allowOverwrite, fallback );
+        }
         if ( mem == MAP_FAILED ) {
             printf( "[ERROR] SharedMemory::CreateNew(%s) mmap fail: %s\n", name_.c_str(), strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
@@ -197,18 +471,30 @@ public:
         memset( mem, 0, size_ );
 
         data_ = ( T* )mem;
+        sync_ = ( SharedMemorySyncBlock* )( ( char* )mem + kSyncBlockOffset );
+        ReportBacking( PageFaults() - faults );
         return hadToDelete;
     }
 
     /*!
      * Attach to an existing shared memory object.
+     * Segments that are not in POSIX shm are looked up on hugetlbfs.
      */
-    void Attach( const std::string& name ) {
+    void Attach( const std::string& name, const SharedMemoryOptions& options = SharedMemoryOptions() ) {
         assert( !data_ );
         name_ = name;
         size_ = sizeof( T );
         printf( "[Shared Memory] open existing %s size %ld bytes\n", name.c_str(), size_ );
+        long faults = PageFaults();
         fd_ = shm_open( name.c_str(), O_RDWR, S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP | S_IROTH );
+        hugetlbfs_ = false;
+        if ( fd_ == -1 && errno == ENOENT ) {
+            fd_        = open( HugetlbfsPath().c_str(), O_RDWR );
+            hugetlbfs_ = fd_ != -1;
+            if ( !hugetlbfs_ ) {
+                errno = ENOENT;
+            }
+        }
         if ( fd_ == -1 ) {
             printf( "[ERROR] SharedMemoryObject::Attach shm_open(%s) failed: %s\n", name_.c_str(), strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
@@ -231,7 +517,15 @@ public:
             return;
         }
 
-        void* mem = mmap( nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0 );
+        // segments created by an older simulator have no sync block, those
+        // can only be driven with semaphores
+        bool has_sync_block = ( size_t )s.st_size >= kSyncBlockOffset + sizeof( SharedMemorySyncBlock );
+        if ( has_sync_block ) {
+            size_ = kSyncBlockOffset + sizeof( SharedMemorySyncBlock );
+        }
+        size_ = RoundToPage( size_ );
+
+        void* mem = Map( options );
         if ( mem == MAP_FAILED ) {
             printf( "[ERROR] SharedMemory::Attach(%s) mmap fail: %s\n", name_.c_str(), strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
@@ -239,6 +533,8 @@ public:
         }
 
         data_ = ( T* )mem;
+        sync_ = has_sync_block ? ( SharedMemorySyncBlock* )( ( char* )mem + kSyncBlockOffset ) : nullptr;
+        ReportBacking( PageFaults() - faults );
     }
 
     /*!
@@ -256,8 +552,9 @@ public:
         }
 
         data_ = nullptr;
+        sync_ = nullptr;
 
-        if ( shm_unlink( name_.c_str() ) ) {
+        if ( hugetlbfs_ ? unlink( HugetlbfsPath().c_str() ) : shm_unlink( name_.c_str() ) ) {
             printf( "[ERROR] SharedMemoryObject::CloseNew (%s) shm_unlink %s\n", name_.c_str(), strerror( errno ) );
             throw std::runtime_error( "Failed to create shared memory!" );
             return;
@@ -289,6 +586,7 @@ public:
         }
 
         data_ = nullptr;
+        sync_ = nullptr;
 
         // close fd
         if ( close( fd_ ) ) {
@@ -303,32 +601,79 @@ public:
     /*********************       For Syncronize           ************************/
     /*!
      * The init() method should only be called *after* shared memory is connected!
-     * This initializes the shared memory semaphores used to keep things in sync
+     * This initializes the primitives used to keep things in sync.
+     *
+     * The host chooses the sync mode and records it in the segment; the other
+     * side ignores its mode argument and follows whatever the host picked.
+     * Both sides must pass the same instance, it scopes the semaphore names.
      */
-    void Init( bool is_host = false ) {
-        robot_to_sim_semaphore_.Init( "/robot2sim", 0, is_host );
-        sim_to_robot_semaphore_.Init( "/sim2robot", 0, is_host );
+    void Init( bool is_host = false, SharedMemorySyncMode mode = SharedMemorySyncMode::kSemaphore, int instance = 0 ) {
+        if ( sync_ ) {
+            if ( is_host ) {
+                sync_->mode.store( ( u32 )mode, std::memory_order_release );
+            }
+            else {
+                mode = ( SharedMemorySyncMode )sync_->mode.load( std::memory_order_acquire );
+            }
+        }
+        else if ( mode != SharedMemorySyncMode::kSemaphore ) {
+            printf( "[Shared Memory] %s has no sync block, falling back to semaphores\n", name_.c_str() );
+            mode = SharedMemorySyncMode::kSemaphore;
+        }
+        mode_ = mode;
+
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            robot_to_sim_seqlock_.Init( &sync_->robot_to_sim );
+            sim_to_robot_seqlock_.Init( &sync_->sim_to_robot );
+        }
+        else {
+            robot_to_sim_semaphore_.Init( InstanceScopedName( "/robot2sim", instance ).c_str(), 0, is_host );
+            sim_to_robot_semaphore_.Init( InstanceScopedName( "/sim2robot", instance ).c_str(), 0, is_host );
+        }
+        printf( "[Shared Memory] %s synchronized with %s\n", name_.c_str(), mode_ == SharedMemorySyncMode::kSeqlock ? "seqlock" : "semaphores" );
+    }
+
+    /*!
+     * The sync mode chosen at Init()
+     */
+    SharedMemorySyncMode SyncMode() const {
+        return mode_;
     }
 
     /*!
      * Wait for the simulator to respond
      */
     void WaitForSimulator() {
-        sim_to_robot_semaphore_.Decrement();
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            sim_to_robot_seqlock_.Decrement();
+        }
+        else {
+            sim_to_robot_semaphore_.Decrement();
+        }
     }
 
     /*!
      * Simulator signals that it is done
      */
     void SimulatorIsDone() {
-        sim_to_robot_semaphore_.Increment();
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            sim_to_robot_seqlock_.Increment();
+        }
+        else {
+            sim_to_robot_semaphore_.Increment();
+        }
     }
 
     /*!
      * Wait for the robot to finish
      */
     void WaitForRobot() {
-        robot_to_sim_semaphore_.Decrement();
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            robot_to_sim_seqlock_.Decrement();
+        }
+        else {
+            robot_to_sim_semaphore_.Decrement();
+        }
     }
 
     /*!
@@ -336,23 +681,68 @@ public:
      * @return if the robot is done
      */
     bool TryWaitForRobot() {
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            return robot_to_sim_seqlock_.TryDecrement();
+        }
         return robot_to_sim_semaphore_.TryDecrement();
     }
 
     /*!
      * Wait for the robot to finish with a timeout
+     * @param seconds, nanoseconds : timeout, practically forever by default
      * @return if we finished before timing out
      */
-    bool WaitForRobotWithTimeout() {
-        // TODO: for DEBUG ONLY
-        return robot_to_sim_semaphore_.DecrementTimeout( 10000000, 0 );
+    bool WaitForRobotWithTimeout( u64 seconds = 10000000, u64 nanoseconds = 0 ) {
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            return robot_to_sim_seqlock_.DecrementTimeout( seconds, nanoseconds );
+        }
+        return robot_to_sim_semaphore_.DecrementTimeout( seconds, nanoseconds );
+    }
+
+    /*!
+     * Drop answers left by a robot that stopped answering, so that the next
+     * signal comes from a robot that is alive. Only the simulator's own
+     * channel is drained: the robot consumes sim_to_robot, a signal left there
+     * is answered like any other and the simulator resyncs with its probe
+     * @return number of signals dropped
+     */
+    int DrainSignals() {
+        int drained = 0;
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            while ( robot_to_sim_seqlock_.TryDecrement() ) {
+                drained++;
+            }
+        }
+        else {
+            while ( robot_to_sim_semaphore_.TryDecrement() ) {
+                drained++;
+            }
+        }
+        return drained;
+    }
+
+    /*!
+     * Signals of the simulator the robot has not taken yet, e.g. left by a
+     * robot that stopped answering. Only read, the robot owns the channel
+     * @return number of signals pending
+     */
+    int SignalsPendingForRobot() {
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            return ( int )sim_to_robot_seqlock_.Pending();
+        }
+        return sim_to_robot_semaphore_.Value();
     }
 
     /*!
      * Signal that the robot is done
      */
     void RobotIsDone() {
-        robot_to_sim_semaphore_.Increment();
+        if ( mode_ == SharedMemorySyncMode::kSeqlock ) {
+            robot_to_sim_seqlock_.Increment();
+        }
+        else {
+            robot_to_sim_semaphore_.Increment();
+        }
     }
 
     /*!
@@ -371,12 +761,95 @@ public:
         return *data_;
     }
 
+    /*!
+     * Page faults this process took while creating or attaching the object
+     */
+    long SetupFaults() const {
+        return setup_faults_;
+    }
+
 private:
-    SharedMemorySemaphore robot_to_sim_semaphore_, sim_to_robot_semaphore_;
-    T*                    data_ = nullptr;
-    std::string           name_;
-    size_t                size_;
-    int                   fd_;
+    std::string HugetlbfsPath() const {
+        return SHARED_MEMORY_HUGETLBFS_PATH + name_;
+    }
+
+    /*!
+     * Round a size up to the page size of the open file, huge pages on hugetlbfs
+     */
+    size_t RoundToPage( size_t size ) const {
+        size_t page = sysconf( _SC_PAGESIZE );
+#ifdef __linux__
+        struct statfs fs;
+        if ( hugetlbfs_ && fstatfs( fd_, &fs ) == 0 && fs.f_type == HUGETLBFS_MAGIC ) {
+            page = fs.f_bsize;
+        }
+#endif
+        return ( size + page - 1 ) / page * page;
+    }
+
+    void* Map( const SharedMemoryOptions& options ) {
+        int flags  = MAP_SHARED;
+        populated_ = false;
+#ifdef MAP_POPULATE
+        if ( options.populate ) {
+            flags |= MAP_POPULATE;
+            populated_ = true;
+        }
+#else
+        if ( options.populate ) {
+            printf( "[Shared Memory] MAP_POPULATE unavailable, %s is not prefaulted\n", name_.c_str() );
+        }
+#endif
+        void* mem = mmap( nullptr, size_, PROT_READ | PROT_WRITE, flags, fd_, 0 );
+        if ( mem == MAP_FAILED ) {
+            return mem;
+        }
+
+        thp_ = false;
+#ifdef MADV_HUGEPAGE
+        if ( options.backing == SharedMemoryBacking::kTransparentHugePages ) {
+            thp_ = madvise( mem, size_, MADV_HUGEPAGE ) == 0;
+            if ( !thp_ ) {
+                printf( "[Shared Memory] transparent huge pages unavailable for %s: %s\n", name_.c_str(), strerror( errno ) );
+            }
+        }
+#endif
+        locked_ = false;
+        if ( options.lock ) {
+            locked_ = mlock( mem, size_ ) == 0;
+            if ( !locked_ ) {
+                printf( "[Shared Memory] mlock of %s failed, check ulimit -l: %s\n", name_.c_str(), strerror( errno ) );
+            }
+        }
+        return mem;
+    }
+
+    static long PageFaults() {
+        struct rusage usage;
+        getrusage( RUSAGE_SELF, &usage );
+        return usage.ru_minflt + usage.ru_majflt;
+    }
+
+    void ReportBacking( long faults ) {
+        setup_faults_ = faults;
+        printf( "[Shared Memory] %s: %ld bytes on %s%s%s, %ld page faults during setup\n", name_.c_str(), size_,
+                hugetlbfs_ ? "hugetlbfs" : ( thp_ ? "transparent huge pages" : "normal pages" ), populated_ ? ", prefaulted" : "",
+                locked_ ? ", locked" : "", faults );
+    }
+
+    SharedMemorySemaphore  robot_to_sim_semaphore_, sim_to_robot_semaphore_;
+    SharedMemorySeqlock    robot_to_sim_seqlock_, sim_to_robot_seqlock_;
+    SharedMemorySyncMode   mode_ = SharedMemorySyncMode::kSemaphore;
+    SharedMemorySyncBlock* sync_ = nullptr;
+    T*                     data_ = nullptr;
+    std::string            name_;
+    size_t                 size_;
+    int                    fd_;
+    bool                   hugetlbfs_    = false;
+    bool                   thp_          = false;
+    bool                   populated_    = false;
+    bool                   locked_       = false;
+    long                   setup_faults_ = 0;
 };
 
 #endif  // PROJECT_SHAREDMEMORY_H
@@ -14,11 +14,17 @@
 #ifndef LCM_HANDLER_HPP__
 #define LCM_HANDLER_HPP__
 
+#include <atomic>
+#include <semaphore.h>
+#include <thread>
+#include <vector>
+
 #include <lcm/lcm-cpp.hpp>
 
 #include "simulator_lcmt.hpp"
 #include "gamepad_lcmt.hpp"
 #include "sim_utilities/gamepad_command.hpp" 
+#include "spsc_ring.hpp"
 
 
 namespace gazebo
@@ -30,30 +36,36 @@ namespace gazebo
         /**
          * @brief Construct a new LCMHandler object
          * 
+         * @param instance simulator instance, instance 0 uses the default lcm url
+         * @param state_decimation publish every nth simulator state, 0 disables the channel
          */
-        LCMHandler();
+        LCMHandler(int instance = 0, int state_decimation = 1);
+
+        ~LCMHandler();
         
         /**
-         * @brief Receive gamepad command messages
+         * @brief Take the latest gamepad command decoded by the reactor thread
          * 
-         * @return GamepadCommand
+         * @param command set to the latest gamepad command
+         * @return true a gamepad command arrived since the last call
+         * @return false no new gamepad command, command is untouched
          */
-        GamepadCommand ReceiveGPC();
+        bool ReceiveGPC(GamepadCommand &command);
         
         /**
-         * @brief Send simlator state message by lcm
+         * @brief Queue simlator state message for the publisher thread, it
+         *        is dropped if the publisher is behind
          * 
          * @param _lcm_sim_handler simlator state message
          */
         void SendSimData(simulator_lcmt &_lcm_sim_handler);
 
         /**
-         * @brief Return true if lcmhandler receive a lcm message
+         * @brief Number of simulator states dropped because the queue was full
          * 
-         * @return true Lcmhandler receive a lcm message
-         * @return false No lcm message is received
+         * @return long 
          */
-        bool HasEvent();
+        long Dropped() const {return dropped_.load(std::memory_order_relaxed);}
 
     private:
 
@@ -65,11 +77,38 @@ namespace gazebo
          * @param msg 
          */
         void HandleCommand(const lcm::ReceiveBuffer *rbuf, const std::string &chan, const gamepad_lcmt *msg);
+
+        /**
+         * @brief Wait on the lcm socket with epoll and dispatch incoming messages
+         * 
+         */
+        void ReactorLoop();
+
+        /**
+         * @brief Encode queued simulator states into a reused buffer and publish them
+         * 
+         */
+        void PublishLoop();
         
         lcm::LCM lcm_;
-        gamepad_lcmt lcm_gamepad_;
 
-        GamepadCommand gamepad_command_;
+        // Incoming messages are handled on the reactor thread, woken up by stop_fd_ to exit
+        std::thread reactor_;
+        int epoll_fd_ = -1;
+        int stop_fd_ = -1;
+        SpscMailbox<GamepadCommand> gamepad_mailbox_;
+
+        // Simulator states from the physics thread to the publisher thread, which
+        // is only posted when it set publisher_waiting_ on an empty queue
+        SpscRing<simulator_lcmt, 16> state_queue_;
+        sem_t state_ready_;
+        std::atomic<bool> publisher_waiting_{false};
+        std::thread publisher_;
+        std::atomic<bool> publishing_{false};
+        std::atomic<long> dropped_{0};
+        std::vector<uint8_t> encode_buffer_;
+        int state_decimation_;
+        long state_count_ = 0;
     };
 
 }
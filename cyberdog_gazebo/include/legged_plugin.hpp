@@ -24,8 +24,15 @@
 #include "legged_simparam.hpp"
 #include "actuator.hpp"
 #include "lcmhandler.hpp"
+#include "spsc_ring.hpp"
+#include "tick_profiler.hpp"
+#include "realtime.hpp"
+#include "async_logger.hpp"
 
 #include <cyberdog_msg/msg/apply_force.hpp>
+#include <cyberdog_msg/msg/tick_profile.hpp>
+#include <cyberdog_msg/msg/controller_connection.hpp>
+#include <cyberdog_msg/srv/step_simulation.hpp>
 
 namespace gazebo
 {
@@ -33,20 +40,37 @@ namespace gazebo
   struct _contact_force //Holds contact force data from foot contact sensors 
   {
     Eigen::Vector3d force; 
-    std::string parent_name;
+    physics::LinkPtr parent_link; // null if the foot is not in contact
+  };
+
+  struct _foot_contact //Holds foot contact wrench read from the physics engine 
+  {
+    std::vector<physics::Collision*> collisions; 
+    ignition::math::Vector3d force; // world frame, summed over the physics steps of a control tick
+    ignition::math::Vector3d cop;   // world frame contact points weighted by normal force
+    double normal = 0;              // sum of the normal force weights
   };
 
   struct _apply_force //Holds apply force command from apply_force message
   {
     std::string name; 
-    double time; 
+    physics::LinkPtr link; 
+    double end_time = 0; // sim time to stop applying the force
     ignition::math::Vector3d force; 
     ignition::math::Vector3d rel_pos;
   };
 
+  enum class CommandInterpolation { ZOH, LINEAR }; // Joint targets between control ticks
+
   class LeggedPlugin : public ModelPlugin
   {
   public:
+    /**
+     * @brief Write the tick profile if profiling was enabled
+     * 
+     */
+    ~LeggedPlugin();
+
     /**
      * @brief Called once when gazebo start up.
      *        For more detail, visit https://classic.gazebosim.org/tutorials?tut=plugins_model&cat=write_plugin
@@ -63,7 +87,7 @@ namespace gazebo
      */
     void OnUpdate();
 
-    Eigen::Vector3d forceToBody(_contact_force &_contact_force, physics::ModelPtr _model);
+    Eigen::Vector3d forceToBody(const _contact_force &_contact_force);
 
   private:
     /**
@@ -73,7 +97,15 @@ namespace gazebo
     void GetJointStates();
 
     /**
-     * @brief send sharedmemory data to control program
+     * @brief Read the base pose and twist and fill the lcm telemetry, every
+     *        control tick whether a control program is connected or not
+     * 
+     */
+    void GetBodyStates();
+
+    /**
+     * @brief send sharedmemory data to control program, written in place
+     *        through SimParam::StateView from the states read this tick
      * 
      */
     void SendSMData();
@@ -84,6 +116,13 @@ namespace gazebo
      */
     void SetJointCom();
 
+    /**
+     * @brief Take the command of the finished control tick from sharedmemory,
+     *        it takes effect commandDelay physics steps later
+     * 
+     */
+    void ReceiveCommand();
+
     /**
      * @brief Handle gamepad command lcm messages 
      * 
@@ -101,17 +140,98 @@ namespace gazebo
     void GetContactForce4();
 
     /**
-     * @brief Handle ApplyForce topic message 
+     * @brief Resolve the foot collisions and register them with the contact manager
+     * 
+     * @return true if every foot has at least one collision
+     */
+    bool InitPhysicsContacts();
+
+    /**
+     * @brief Add the foot contact wrenches of the last physics step
+     * 
+     */
+    void AccumulatePhysicsContacts();
+
+    /**
+     * @brief Get the contact force and center of pressure of each foot, averaged
+     *        over the physics steps since the last control tick
+     * 
+     */
+    void GetPhysicsContactForce4();
+
+    /**
+     * @brief Handle ApplyForce topic message on the executor thread, it is
+     *        handed to the physics thread through force_mailbox_
      * 
      * @param msg ApplyForce topic message
      */
     void ForceHandler(const cyberdog_msg::msg::ApplyForce::SharedPtr msg);
 
+    /**
+     * @brief Take the latest ApplyForce message and resolve its link
+     * 
+     */
+    void ReceiveForce();
+
     /**
      * @brief Apply force to the links of robot with the command from ApplyForce topic message 
      * 
      */
     void ApplyForce();
+
+    /**
+     * @brief Handle StepSimulation service, run the requested physics steps while paused
+     * 
+     * @param request number of physics steps
+     * @param response world iterations and sim time after the steps
+     */
+    void StepHandler(const std::shared_ptr<cyberdog_msg::srv::StepSimulation::Request> request,
+                     std::shared_ptr<cyberdog_msg::srv::StepSimulation::Response> response);
+
+    /**
+     * @brief Print achieved physics steps per second and real time factor
+     * 
+     */
+    void ReportStepRate();
+
+    /**
+     * @brief Print the actuator limit violations counted since the last report
+     * 
+     */
+    void ReportActuatorLimits();
+
+    /**
+     * @brief Apply rtPriority and cpuAffinity to the gazebo update thread, on its first update
+     * 
+     */
+    void ApplyRealTime();
+
+    /**
+     * @brief Publish the per-phase durations of the last profile period on tick_profile
+     * 
+     */
+    void ReportProfile();
+
+    /**
+     * @brief Hold the joints while the control program is disconnected and
+     *        take it back once it attaches again, called every control tick
+     * 
+     */
+    void WatchController();
+
+    /**
+     * @brief Replace pending commands with pure joint damping at the current positions
+     * 
+     */
+    void HoldJoints();
+
+    /**
+     * @brief Publish a change of the control program connection on controller_connection
+     * 
+     * @param state cyberdog_msg::msg::ControllerConnection::CONNECTED or DISCONNECTED
+     * @param reason 
+     */
+    void PublishConnection(uint8_t state, const std::string &reason);
     
     // Pointer to the model
     physics::ModelPtr model_;
@@ -134,19 +254,55 @@ namespace gazebo
     gazebo::sensors::ContactSensorPtr contact_sensor_hl_;
     gazebo::sensors::ContactSensorPtr contact_sensor_hr_;
 
-    // Gazebo joint names vector
-    std::vector<std::string> joint_names_;
+    // Gazebo joints resolved once in Load, in control program order: entry
+    // 3*leg+j drives joint j of control program leg, i.e. gazebo leg kleg_map[leg]
+    gazebo::physics::JointPtr joints_[12];
+
+    // Sign from gazebo joint direction to control program joint direction
+    double joint_sign_[12];
+
+    // Links read or pushed every tick
+    gazebo::physics::LinkPtr base_link_;
+    gazebo::physics::LinkPtr foot_links_[4];
 
-    // Gazebo joint map
-    std::map<std::string, gazebo::physics::JointPtr> joint_map_;
+    // Foot contacts read from the contact manager every physics step
+    gazebo::physics::ContactManager *contact_manager_ = nullptr;
+    _foot_contact foot_contacts_[4];
+    int contact_steps_ = 0;
 
     // ApplyForce topic subscription
     std::shared_ptr<GazeboNode> force_node_;
     rclcpp::Subscription<cyberdog_msg::msg::ApplyForce>::SharedPtr for_sub_;    
+    SpscMailbox<cyberdog_msg::msg::ApplyForce> force_mailbox_;
     _apply_force apply_force_;
 
-    // Shared memory message
-    SimulatorToRobotMessage simToRobot;
+    // StepSimulation service, served while physics is paused
+    std::shared_ptr<GazeboNode> step_node_;
+    rclcpp::Service<cyberdog_msg::srv::StepSimulation>::SharedPtr step_srv_;
+
+    // Per-phase timing of OnUpdate, summarized on tick_profile and dumped to profile_file_
+    TickProfiler profiler_;
+    std::string profile_file_;
+    std::shared_ptr<GazeboNode> profile_node_;
+    rclcpp::Publisher<cyberdog_msg::msg::TickProfile>::SharedPtr profile_pub_;
+
+    // Control program watchdog, joints are damped while it is disconnected
+    bool controller_connected_ = true;
+    double safe_hold_kd_ = 1.0;
+    std::string disconnect_reason_;
+    std::shared_ptr<GazeboNode> connection_node_;
+    rclcpp::Publisher<cyberdog_msg::msg::ControllerConnection>::SharedPtr connection_pub_;
+
+    // Scheduling of the gazebo update thread, applied on the first update
+    int rt_priority_ = 0;
+    uint64_t sim_cpus_ = 0;
+    bool realtime_applied_ = false;
+
+    // Free running lockstep and its step rate report
+    bool lockstep_ = false;
+    std::chrono::steady_clock::time_point report_wall_time_;
+    double report_sim_time_ = 0;
+    long report_step_count_ = 0;
 
     // Lcm message of simulator state 
     simulator_lcmt lcm_sim_handler_;
@@ -155,18 +311,47 @@ namespace gazebo
     LCMHandler*   lcmhandler_   =   nullptr;
     NodeExc*      node_executor_ =   nullptr;
     
-    std::vector<double> q_;
-    std::vector<double> dq_;
-    std::vector<double> tau_;
-    std::vector<double> contact_;
-    std::vector<double> q_ctrl_;
-    std::vector<double> dq_ctrl_;
-    std::vector<double> tau_ctrl_;
-    Actuator motor_;
+    // Joint states in control program order, dq_ keeps the gazebo direction for the motor model
+    double dq_[12];
+    double q_ctrl_[12];
+    double dq_ctrl_[12];
+    double tau_ctrl_[12];
+    ActuatorBatch motor_;
+    ActuatorCounters actuator_counters_;
+    double actuator_report_time_ = 0;
 
     int foot_counter_;
     int frequency_counter_;
 
+    // Physics steps per control tick and how joint targets are held in between
+    int control_decimation_ = 2;
+    CommandInterpolation command_interpolation_ = CommandInterpolation::ZOH;
+
+    // Overlap controller compute with the physics steps of the next control
+    // tick, commands then apply one control period late
+    bool controller_pipeline_ = false;
+
+    // Received commands with the physics step they take effect, a ring sized
+    // for commandDelay physics steps of transport delay
+    int command_delay_ = 0;
+    std::vector<std::pair<long, SpiCommand>> cmd_queue_;
+    size_t cmd_queue_head_ = 0;
+    size_t cmd_queue_size_ = 0;
+    long step_count_ = 0;
+
+    // Applied command, the one before it and physics steps since it took effect
+    SpiCommand cmd_;
+    SpiCommand cmd_prev_;
+    int cmd_steps_ = 0;
+
+    // Spine boards between the command and the motors, fed the joint states of every physics step
+    SpineBoard spine_board_;
+    SpiData spi_data_;
+
+    // Base states read once per control tick by GetBodyStates
+    ignition::math::Pose3d base_pose_;
+    ignition::math::Vector3d base_vel_;
+    ignition::math::Vector3d base_omega_;
     Eigen::Quaterniond q_body_;
     uint kleg_map[4] = {1, 0, 3, 2};
     
@@ -174,5 +359,6 @@ namespace gazebo
     bool use_TNcurve_motormodel_;
     bool use_torque_response_;
     bool use_force_contact_sensor_;
+    bool use_physics_contact_;
   };
 }
@@ -26,6 +26,10 @@
 #include "ctrl_ros/control_parameters/control_parameters.hpp"
 #include "ctrl_ros/control_parameters/robot_parameters.hpp"
 #include "node_executor.hpp"
+#include "spsc_ring.hpp"
+#include "tick_profiler.hpp"
+#include "async_logger.hpp"
+#include "controller_library.hpp"
 
 namespace gazebo
 {
@@ -34,8 +38,28 @@ namespace gazebo
         std::string name;
         ControlParameterValueKind kind;
         ControlParameterValue value;
+        bool is_user = false;
     };
-    
+
+    /**
+     * @brief Typed references into the sharedmemory for the state of the next
+     *        control tick. Fields are written in place and handed to the
+     *        control program by SimParam::CommitState, nothing is copied
+     */
+    struct SimulatorStateView
+    {
+        VectorNavData&          vectorNav;
+        CheaterState<double>&   cheaterState;
+        SpiData&                spiData;
+        GamepadCommand&         gamepadCommand;     // kept until overwritten, the control program sees the last one
+    };
+
+    /**
+     * @brief Outcome of SimParam::CollectSMData, only kCollected leaves a new
+     *        command in the sharedmemory
+     */
+    enum class CollectResult { kIdle, kCollected, kFailed };
+
     class SimParam
     {
     public: 
@@ -44,8 +68,31 @@ namespace gazebo
          * 
          * @param model_name name of robot
          * @param node_executor node executor to subscribe yaml message
+         * @param sync_mode how to synchronize with control program through sharedmemory
+         * @param instance simulator instance, scopes the sharedmemory and semaphore names
+         * @param shm_options prefault, lock and huge page backing of the sharedmemory
          */
-        SimParam(std::string model_name, NodeExc* node_executor);
+        SimParam(std::string model_name, NodeExc* node_executor, SharedMemorySyncMode sync_mode = SharedMemorySyncMode::kSemaphore, int instance = 0,
+                 const SharedMemoryOptions& shm_options = SharedMemoryOptions());
+
+        /**
+         * @brief Unlink the per instance segments created by this simulator, so
+         *        repeated runs do not leave them in /dev/shm
+         * 
+         */
+        ~SimParam();
+
+        /**
+         * @brief Run the control program from a shared library in this process
+         *        instead of talking to it through the sharedmemory semaphores,
+         *        must be called before FirstRun
+         * 
+         * @param path shared library implementing controller_library_interface.hpp
+         * @param args passed to its sim_controller_init
+         * @return true the library controller is loaded
+         * @return false it failed to load, the sharedmemory is used
+         */
+        bool LoadControllerLibrary(const std::string& path, const std::string& args);
 
         /**
          * @brief Build connection to control program at the first run
@@ -54,11 +101,48 @@ namespace gazebo
         void FirstRun();
 
         /**
-         * @brief Send sharedmemory data to control program
+         * @brief Take the control program back after it stopped answering. Polls
+         *        without blocking and runs the FirstRun handshake and parameter
+         *        upload again once a control program attaches to the sharedmemory
+         * 
+         * @return true the control program is connected again
+         * @return false still waiting for it
+         */
+        bool PollReconnect();
+
+        /**
+         * @brief Whether the control program answers, cleared when it times out
+         *        or reports an error
+         * 
+         * @return true connected
+         * @return false waiting for a control program
+         */
+        bool Connected() const {return connected_;}
+
+        /**
+         * @brief Set how long the control program may take to answer before it
+         *        is considered disconnected
+         * 
+         * @param seconds timeout, 1 s unless set, 0 waits forever
+         */
+        void SetControllerTimeout(double seconds);
+
+        /**
+         * @brief Set the function called with the reason when the control program
+         *        times out or reports an error
          * 
-         * @param _SimToRobot sharedmemory data to control program
+         * @param callback 
          */
-        void SendSMData(SimulatorToRobotMessage _SimToRobot);
+        void SetErrorCallback(std::function< void( std::string ) > callback) {error_callback_ = callback;}
+
+        /**
+         * @brief Wait for the control program to finish the published tick, if any
+         * 
+         * @return CollectResult kCollected with a new command in sharedmemory,
+         *         kIdle when no tick was in flight, kFailed when the control
+         *         program timed out or reported an error
+         */
+        CollectResult CollectSMData();
 
         /**
          * @brief Receive sharedmemory data from control program
@@ -68,18 +152,83 @@ namespace gazebo
         SpiCommand ReceiveSMData();
 
         /**
-         * @brief Receive YamlParam topic message
+         * @brief Whether the state of the next tick may be written through
+         *        StateView, i.e. the control program is connected and no tick
+         *        is in flight that it could still be reading
+         * 
+         * @return true StateView may be written and committed
+         * @return false leave the sharedmemory alone this tick
+         */
+        bool StateWritable();
+
+        /**
+         * @brief References into the sharedmemory for the state of the next
+         *        tick, write only while StateWritable
+         * 
+         * @return SimulatorStateView 
+         */
+        SimulatorStateView StateView();
+
+        /**
+         * @brief Hand the state written through StateView to the control program
+         *        without waiting, so physics can run while it computes
+         * 
+         */
+        void CommitState();
+
+        /**
+         * @brief Command of the tick collected by CollectSMData, read in place.
+         *        Valid until the next CommitState, copy it to keep it longer
+         * 
+         * @return const SpiCommand& 
+         */
+        const SpiCommand& CommandView() {return shared_memory_().robotToSim.spiCommand;}
+
+        /**
+         * @brief Send the control parameters queued by YamlParam topic messages
          * 
          */
         void ReceiveTopic();
 
         /**
-         * @brief Set the LcmHasEvent if gamepad lcm message is received
+         * @brief Set the time the control program has to answer a tick, slower
+         *        answers count as deadline misses in the timing stats
+         * 
+         * @param deadline_ns deadline in nanoseconds
+         */
+        void SetControllerDeadline(u64 deadline_ns);
+
+        /**
+         * @brief Controller timing stats, also readable from other processes
+         *        through the development-simulator-stats sharedmemory
          * 
-         * @return true Gamepad lcm message is received
-         * @return false No gamepad lcm message is received
+         * @return ControllerTiming 
          */
-        void LcmHasEvent(){lcm_has_event_ = true;};
+        ControllerTiming TimingStats() {return stats_memory_().Read();}
+
+        /**
+         * @brief Recommend a real time configuration to the control program
+         *        through the sharedmemory, it may apply it when it attaches
+         * 
+         * @param priority SCHED_FIFO priority, 0 for none
+         * @param affinity bit i set for cpu i, 0 for any
+         */
+        void RecommendControllerRealTime(int priority, u64 affinity);
+
+        /**
+         * @brief Get the visualization data written by control program. With the
+         *        compact sharedmemory layout its segment is mapped on the first call
+         * 
+         * @return VisualizationData& visualization data of control program
+         */
+        VisualizationData& GetVisualizationData();
+
+        /**
+         * @brief Get the robot pose drawn by control program, mapped like GetVisualizationData
+         * 
+         * @return CheetahVisualization& robot pose of control program
+         */
+        CheetahVisualization& GetMainCheetahVisualization();
         
     private:
 
@@ -101,13 +250,86 @@ namespace gazebo
         void SendControlParameter( const std::string& name, ControlParameterValue value, ControlParameterValueKind kind, bool isUser );
 
         /**
-         * @brief Handle error message if control program has a error
+         * @brief Send all robot and user parameters, in one transaction if the
+         *        control program supports the ControlParameterTable
+         * 
+         */
+        void UploadControlParameters();
+
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        /**
+         * @brief Send all robot and user parameters through the ControlParameterTable,
+         *        one kSET_ALL_PARAMS request per table full of parameters
+         * 
+         * @return std::vector< ControlParameterStatus > status of every parameter, robot parameters first
+         */
+        std::vector< ControlParameterStatus > SendAllControlParameters();
+
+        /**
+         * @brief Commit the filled ControlParameterTable with a kSET_ALL_PARAMS request
+         * 
+         * @param status status of every committed entry is appended here
+         * @return true the robot answered
+         * @return false control program timed out
+         */
+        bool CommitControlParameterTable( std::vector< ControlParameterStatus >& status );
+
+        /**
+         * @brief Create the control parameter table sharedmemory and tell control program to attach it
+         * 
+         */
+        void MapControlParameterTable();
+#endif
+
+        /**
+         * @brief Record the round trip of the tick just collected in the timing stats
+         * 
+         * @param now CLOCK_MONOTONIC ns when the answer was noticed
+         */
+        void RecordControllerTiming(s64 now);
+
+        /**
+         * @brief Let the control program answer the message for its mode, by
+         *        a call into the library controller or through the sharedmemory
+         * 
+         * @return true the control program answered
+         * @return false control program timed out or failed
+         */
+        bool RunRobot();
+
+        /**
+         * @brief Wait for the control program to answer within the controller timeout
+         * 
+         * @return true the control program answered
+         * @return false control program timed out
+         */
+        bool WaitForController();
+
+        /**
+         * @brief Handle error message if control program has a error, the
+         *        connection is reset for PollReconnect
          * 
          */
         void HandleControlError();
 
         /**
-         * @brief Handle YamlParam topic message
+         * @brief Forget the state of the lost control program, so that the next
+         *        one attaching starts from a clean handshake
+         * 
+         */
+        void ResetConnection();
+
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        /**
+         * @brief Create the visualization sharedmemory and tell control program to attach it
+         * 
+         */
+        void MapVisualization();
+#endif
+
+        /**
+         * @brief Handle YamlParam topic message on the executor thread, the
+         *        parameter is queued for ReceiveTopic
          * 
          * @param msg YamlParam topic message
          */
@@ -115,15 +337,33 @@ namespace gazebo
 
 
         SharedMemoryObject<SimulatorMessage>    shared_memory_;
+        int                                     instance_;
+        ControllerLibrary                       controller_library_;
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        SharedMemoryObject<VisualizationMessage> visualization_memory_;
+        bool                                    visualization_mapped_       = false;
+        SharedMemoryObject<ControlParameterTable> parameter_table_memory_;
+        bool                                    parameter_table_mapped_     = false;
+#endif
     
         RobotType robotType;
         ControlParameters                       user_parameters_;
         RobotControlParameters                  robot_parameters_;
-        bool                                    lcm_has_event_;
+        bool                                    robot_pending_              = false;
+
+        // round trip timing of RUN_CONTROLLER ticks
+        SharedMemoryObject<ControllerTimingStats> stats_memory_;
+        TickHistogram                           round_trip_;
+        s32                                     tick_sequence_              = 0;
+        double                                  round_trip_sum_             = 0;
+        double                                  wake_sum_                   = 0;
+        double                                  compute_sum_                = 0;
+        double                                  return_sum_                 = 0;
 
         // ros2 node to receive YamlParam topic
         std::shared_ptr<GazeboNode> gazebo_node_;
         rclcpp::Subscription<cyberdog_msg::msg::YamlParam>::SharedPtr para_sub_;
+        SpscRing<ParamHandler, 16>              param_queue_;
 
         NodeExc*      node_executor_ =   nullptr;
 
@@ -132,6 +372,12 @@ namespace gazebo
         bool                                    connected_                  = false;
         bool                                    want_stop_                   = false;
 
+        // watchdog, a control program slower than the timeout is disconnected, 0 opts out and waits forever
+        u64                                     timeout_ns_                 = 1000000000;
+        s64                                     disconnect_time_            = 0;
+        bool                                    probe_pending_              = false;
+        int                                     probe_stale_answers_        = 0;
+
     };
 }
 
@@ -14,6 +14,8 @@
 #ifndef _NODE_EXCUTOR_HPP__
 #define _NODE_EXCUTOR_HPP__
 
+#include <thread>
+
 #include "rclcpp/rclcpp.hpp"
 
 namespace gazebo
@@ -25,8 +27,9 @@ namespace gazebo
          * @brief Construct a new GazeboNode object to subscribe topic messages
          * 
          * @param node_name 
+         * @param node_namespace ros namespace of the simulator instance, empty for the root namespace
          */
-        GazeboNode(std::string node_name):Node(node_name){};
+        GazeboNode(std::string node_name, std::string node_namespace = ""):Node(node_name, node_namespace){};
         ~GazeboNode(){};
     };
 
@@ -36,33 +39,51 @@ namespace gazebo
             /**
              * @brief Construct a new NodeExecutor object
              * 
+             * @param node_namespace ros namespace shared by all nodes of this simulator instance
              */
-            NodeExc(){}
+            NodeExc(std::string node_namespace = ""):node_namespace_(node_namespace){}
+
+            ~NodeExc()
+            {
+                background_executor_.cancel();
+                if (background_thread_.joinable()) {
+                    background_thread_.join();
+                }
+            }
 
             /**
-             * @brief Add node into node executor
+             * @brief Create a node in the namespace of this simulator instance
              * 
-             * @param node 
+             * @param node_name 
+             * @return std::shared_ptr<GazeboNode> 
              */
-            void AddNode(std::shared_ptr<GazeboNode> node)
+            std::shared_ptr<GazeboNode> CreateNode(std::string node_name)
             {
-                executor_.add_node(node);
+                return std::make_shared<GazeboNode>(node_name, node_namespace_);
             }
 
             /**
-             * @brief Receive topics
+             * @brief Add node into the executor spinning on its own thread. Topic
+             *        callbacks run off the physics thread and hand their messages
+             *        over through mailboxes, services answer while physics is paused
              * 
+             * @param node 
              */
-            void ReceiveTopic()
+            void AddNode(std::shared_ptr<GazeboNode> node)
             {
-                using namespace std::chrono_literals;
-                auto wait_time = 100ns;
-                executor_.spin_once(wait_time);
+                background_executor_.add_node(node);
+                if (!background_thread_.joinable()) {
+                    background_thread_ = std::thread([this]() { background_executor_.spin(); });
+                }
             }
 
 
         private:
-        rclcpp::executors::SingleThreadedExecutor executor_;
+        // every node has its own callback group, two threads keep a blocking
+        // StepSimulation call from holding up the topics
+        rclcpp::executors::MultiThreadedExecutor background_executor_{rclcpp::ExecutorOptions(), 2};
+        std::thread background_thread_;
+        std::string node_namespace_;
     };
 
 
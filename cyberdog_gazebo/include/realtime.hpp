@@ -0,0 +1,143 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _REALTIME_HPP__
+#define _REALTIME_HPP__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+
+namespace gazebo
+{
+  /**
+   * @brief Parse a cpu list in taskset -c form, e.g. "2" or "0,2-3". Cpus are
+   *        kept as a bit mask, so only the first 64 can be named
+   *
+   * @param list cpu list, empty for no cpus
+   * @param mask bit i set for cpu i
+   * @return false the list is malformed or names a cpu above 63
+   */
+  inline bool ParseCpuList(const std::string &list, uint64_t &mask)
+  {
+    mask = 0;
+    const char *p = list.c_str();
+    while (*p) {
+      char *end;
+      long first = strtol(p, &end, 10);
+      if (end == p) {
+        return false;
+      }
+      long last = first;
+      p = end;
+      if (*p == '-') {
+        last = strtol(p + 1, &end, 10);
+        if (end == p + 1) {
+          return false;
+        }
+        p = end;
+      }
+      if (first < 0 || last > 63 || first > last) {
+        return false;
+      }
+      for (long cpu = first; cpu <= last; cpu++) {
+        mask |= uint64_t(1) << cpu;
+      }
+      if (*p == ',' || *p == ' ') {
+        p++;
+      }
+      else if (*p) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Format a cpu mask as a cpu list
+   *
+   * @param mask bit i set for cpu i
+   * @return std::string e.g. "0,2-3", empty for no cpus
+   */
+  inline std::string CpuListString(uint64_t mask)
+  {
+    std::string list;
+    for (int cpu = 0; cpu < 64; cpu++) {
+      if (!(mask >> cpu & 1)) {
+        continue;
+      }
+      int last = cpu;
+      while (last < 63 && (mask >> (last + 1) & 1)) {
+        last++;
+      }
+      list += (list.empty() ? "" : ",") + std::to_string(cpu) + (last > cpu ? "-" + std::to_string(last) : "");
+      cpu = last;
+    }
+    return list;
+  }
+
+  /**
+   * @brief Pin the calling thread to the cpus in mask
+   *
+   * @param mask bit i set for cpu i, 0 leaves the affinity alone
+   * @return 0 or the errno of the failure
+   */
+  inline int SetThreadAffinity(uint64_t mask)
+  {
+    if (mask == 0) {
+      return 0;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < 64; cpu++) {
+      if (mask >> cpu & 1) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+
+  /**
+   * @brief Run the calling thread under SCHED_FIFO
+   *
+   * @param priority 1 to 99, 0 leaves the scheduling policy alone
+   * @return 0 or the errno of the failure, EPERM without CAP_SYS_NICE or an rtprio limit
+   */
+  inline int SetThreadFifo(int priority)
+  {
+    if (priority <= 0) {
+      return 0;
+    }
+    struct sched_param param = {};
+    param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  }
+
+  /**
+   * @brief Lock current and future pages of the process in memory
+   *
+   * @return 0 or the errno of the failure
+   */
+  inline int LockProcessMemory()
+  {
+    return mlockall(MCL_CURRENT | MCL_FUTURE) ? errno : 0;
+  }
+}
+
+#endif //_REALTIME_HPP__
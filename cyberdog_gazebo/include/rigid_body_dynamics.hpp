@@ -0,0 +1,163 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _RIGID_BODY_DYNAMICS_HPP__
+#define _RIGID_BODY_DYNAMICS_HPP__
+
+#include <vector>
+
+#include "rigid_body_model.hpp"
+
+namespace gazebo
+{
+  /**
+   * @brief Compliant contact of a point with the ground plane z = 0. The
+   *        normal force is a spring-damper on the penetration, the tangential
+   *        force a spring-damper towards the point where contact began,
+   *        limited to the friction cone by dragging that point along. The
+   *        defaults need a physics step of 0.5 ms or less with the light legs
+   *        of the quadruped
+   */
+  struct ContactParameters
+  {
+    double stiffness = 30000;             // normal, N/m
+    double damping = 100;                 // normal, Ns/m
+    double tangential_stiffness = 20000;  // N/m
+    double tangential_damping = 60;       // Ns/m
+    double friction = 0.7;                // Coulomb coefficient, as the foot surface in gazebo.xacro
+  };
+
+  /**
+   * @brief Forward dynamics of a floating base tree by the articulated-body
+   *        algorithm. Joint damping, friction and limits are implicit in the
+   *        joint velocity, ground contacts explicit, the step is semi-implicit
+   *        Euler. Joint arrays are indexed by body, entry 0 is unused
+   */
+  class RigidBodyDynamics
+  {
+  public:
+    static constexpr int kMaxBodies = RigidBodyModel::kMaxBodies;
+
+    explicit RigidBodyDynamics(const RigidBodyModel &model, const ContactParameters &contact = ContactParameters());
+
+    /**
+     * @brief Put the base at rest at a position and orientation, joints at rest at q
+     *
+     * @param position base in the world
+     * @param orientation base to world
+     * @param q joint angles, nullptr for all zero
+     */
+    void Reset(const SpatialVec3 &position, const Eigen::Quaterniond &orientation, const double *q = nullptr);
+
+    /**
+     * @brief Advance by dt with joint torques tau, clipped to the joint effort
+     *
+     * @param tau
+     * @param dt
+     */
+    void Step(const double *tau, double dt);
+
+    double Time() const {return time_;}
+    double Q(int body) const {return q_[body];}
+    double Qd(int body) const {return qd_[body];}
+
+    /**
+     * @brief Joint torque of the last step, after clipping
+     */
+    double Tau(int body) const {return tau_[body];}
+
+    const SpatialVec3 &BasePosition() const {return base_position_;}
+    Eigen::Quaterniond BaseOrientation() const {return base_orientation_;}
+
+    /**
+     * @brief Velocity of the base origin, in base coordinates
+     */
+    SpatialVec3 BaseLinearVelocity() const {return v_[0].tail<3>();}
+
+    /**
+     * @brief Angular velocity of the base, in base coordinates
+     */
+    SpatialVec3 BaseAngularVelocity() const {return v_[0].head<3>();}
+
+    /**
+     * @brief Angular velocity the IMU measures, in IMU coordinates
+     */
+    SpatialVec3 ImuAngularVelocity() const;
+
+    /**
+     * @brief Specific force the IMU measures, acceleration less gravity, in
+     *        IMU coordinates, from the last step
+     */
+    SpatialVec3 ImuLinearAcceleration() const;
+
+    /**
+     * @brief Orientation of the IMU, IMU to world
+     */
+    Eigen::Quaterniond ImuOrientation() const;
+
+    /**
+     * @brief Ground force on a contact point in the last step, in world coordinates
+     */
+    const SpatialVec3 &ContactForce(int contact) const {return contact_force_[contact];}
+
+    /**
+     * @brief Rotation of a body to world
+     */
+    const SpatialMat3 &BodyRotation(int body) const {return rotation_[body];}
+
+  private:
+    /**
+     * @brief Body poses, velocities and the velocity product terms of the current state
+     */
+    void Kinematics();
+
+    /**
+     * @brief Ground forces on every body, in body coordinates
+     */
+    void ContactForces();
+
+    const RigidBodyModel &model_;
+    ContactParameters contact_;
+    int n_;
+    double time_ = 0;
+
+    // state, the base twist is in base coordinates
+    SpatialVec3 base_position_;
+    Eigen::Quaternion<double, Eigen::DontAlign> base_orientation_;
+    double q_[kMaxBodies];
+    double qd_[kMaxBodies];
+    SpatialVec v_[kMaxBodies];
+
+    // per step
+    double tau_[kMaxBodies];
+    SpatialVec a_[kMaxBodies];
+    SpatialTransform up_[kMaxBodies];
+    SpatialVec s_[kMaxBodies];
+    SpatialVec c_[kMaxBodies];
+    SpatialMat IA_[kMaxBodies];
+    SpatialVec pA_[kMaxBodies];
+    SpatialVec U_[kMaxBodies];
+    double D_[kMaxBodies];
+    double u_[kMaxBodies];
+    SpatialVec f_ext_[kMaxBodies];
+    SpatialMat3 rotation_[kMaxBodies];
+    SpatialVec3 position_[kMaxBodies];
+
+    // contacts, the anchor is where the tangential spring is attached
+    std::vector<SpatialVec3> contact_force_;
+    std::vector<SpatialVec3> contact_anchor_;
+    std::vector<bool> in_contact_;
+  };
+}
+
+#endif //_RIGID_BODY_DYNAMICS_HPP__
@@ -0,0 +1,139 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _RIGID_BODY_MODEL_HPP__
+#define _RIGID_BODY_MODEL_HPP__
+
+#include <string>
+#include <vector>
+
+#include <urdf_model/model.h>
+
+#include "spatial.hpp"
+
+namespace gazebo
+{
+  /**
+   * @brief A rigid body of the kinematic tree, a URDF link with the links
+   *        fixed to it merged in. Every body but the floating base hangs
+   *        from its parent by one revolute joint
+   */
+  struct RigidBody
+  {
+    std::string name;
+    std::string joint;          // URDF joint to the parent, empty for the floating base
+    int parent = -1;            // index of the parent body, -1 for the floating base
+    SpatialTransform tree;      // parent body frame to the joint frame
+    SpatialVec3 axis = SpatialVec3::UnitX();  // joint axis in the joint frame, unit length
+    SpatialMat inertia = SpatialMat::Zero();  // spatial inertia in the body frame
+    double damping = 0;         // viscous joint damping, Nms/rad
+    double friction = 0;        // dry joint friction, Nm
+    double lower = -1e9;        // joint limits, rad
+    double upper = 1e9;
+    double effort = 1e9;        // largest joint torque, Nm
+  };
+
+  /**
+   * @brief A point of a body that touches the ground, the center of a sphere
+   *        or the corner of a box
+   */
+  struct ContactPoint
+  {
+    std::string link;           // URDF link the collision belongs to
+    int body = 0;
+    SpatialVec3 position = SpatialVec3::Zero();  // in the body frame
+    double radius = 0;
+  };
+
+  /**
+   * @brief Kinematic and inertial parameters of the quadruped, built from the
+   *        URDF generated from cyberdog_description. Joints, feet and the IMU
+   *        are looked up by the names the xacro gives them
+   */
+  class RigidBodyModel
+  {
+  public:
+    static constexpr int kMaxBodies = 16;
+
+    /**
+     * @brief Build the model from a URDF file
+     *
+     * @param path URDF, e.g. the output of xacro robot.xacro
+     * @param error why the model could not be built
+     * @return false the file could not be parsed or is not a 12 joint quadruped
+     */
+    bool Load(const std::string &path, std::string &error);
+
+    /**
+     * @brief Build the model from a parsed URDF. The root link is the floating
+     *        base, fixed joints merge their child into the parent body and
+     *        revolute or continuous joints start a new body
+     *
+     * @param urdf
+     * @param error
+     * @return false
+     */
+    bool Build(const urdf::ModelInterface &urdf, std::string &error);
+
+    int NumBodies() const {return int(bodies_.size());}
+    const RigidBody &Body(int i) const {return bodies_[i];}
+    const std::vector<ContactPoint> &Contacts() const {return contacts_;}
+
+    /**
+     * @brief Body moved by joint i of the control program, legs FR, FL, RR, RL
+     *        with abad, hip and knee each
+     */
+    int ControlJointBody(int i) const {return control_body_[i];}
+
+    /**
+     * @brief Sign from the URDF joint angle to the control program one
+     */
+    double ControlJointSign(int i) const {return control_sign_[i];}
+
+    /**
+     * @brief Foot contact point of control program leg i, -1 if it has none
+     */
+    int FootContact(int leg) const {return foot_contact_[leg];}
+
+    int ImuBody() const {return imu_body_;}
+    const SpatialTransform &ImuPlacement() const {return imu_placement_;}
+
+    double TotalMass() const {return total_mass_;}
+
+  private:
+    /**
+     * @brief Merge a link and the links fixed to it into a body, recursing into
+     *        its child joints
+     *
+     * @param urdf
+     * @param link
+     * @param body
+     * @param placement body frame to link frame
+     * @param error
+     * @return false a joint type other than fixed, revolute or continuous
+     */
+    bool AddLink(const urdf::ModelInterface &urdf, const urdf::Link &link, int body, const SpatialTransform &placement,
+                 std::string &error);
+
+    std::vector<RigidBody> bodies_;
+    std::vector<ContactPoint> contacts_;
+    int control_body_[12];
+    double control_sign_[12];
+    int foot_contact_[4];
+    int imu_body_ = 0;
+    SpatialTransform imu_placement_;
+    double total_mass_ = 0;
+  };
+}
+
+#endif //_RIGID_BODY_MODEL_HPP__
@@ -0,0 +1,167 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _SPATIAL_HPP__
+#define _SPATIAL_HPP__
+
+#include <cmath>
+
+#include <eigen3/Eigen/Dense>
+
+namespace gazebo
+{
+  // Spatial vectors in Featherstone's convention, motion [angular; linear]
+  // and force [moment; force]. Unaligned so they can live anywhere
+  typedef Eigen::Matrix<double, 3, 1, Eigen::DontAlign> SpatialVec3;
+  typedef Eigen::Matrix<double, 3, 3, Eigen::DontAlign> SpatialMat3;
+  typedef Eigen::Matrix<double, 6, 1, Eigen::DontAlign> SpatialVec;
+  typedef Eigen::Matrix<double, 6, 6, Eigen::DontAlign> SpatialMat;
+
+  inline SpatialMat3 Skew(const SpatialVec3 &v)
+  {
+    SpatialMat3 m;
+    m << 0, -v[2], v[1],
+         v[2], 0, -v[0],
+         -v[1], v[0], 0;
+    return m;
+  }
+
+  /**
+   * @brief Rotation of a frame turned by angle about axis, columns are the turned axes
+   */
+  inline SpatialMat3 AxisRotation(const SpatialVec3 &axis, double angle)
+  {
+    return Eigen::AngleAxisd(angle, axis).toRotationMatrix();
+  }
+
+  /**
+   * @brief Rotation of URDF roll, pitch and yaw, about fixed x, y then z
+   */
+  inline SpatialMat3 RpyRotation(double roll, double pitch, double yaw)
+  {
+    return (Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()) * Eigen::AngleAxisd(pitch, Eigen::Vector3d::UnitY()) *
+            Eigen::AngleAxisd(roll, Eigen::Vector3d::UnitX())).toRotationMatrix();
+  }
+
+  /**
+   * @brief Cross product of motion vectors, v x m
+   */
+  inline SpatialVec MotionCross(const SpatialVec &v, const SpatialVec &m)
+  {
+    SpatialVec out;
+    out.head<3>() = v.head<3>().cross(m.head<3>());
+    out.tail<3>() = v.head<3>().cross(m.tail<3>()) + v.tail<3>().cross(m.head<3>());
+    return out;
+  }
+
+  /**
+   * @brief Cross product of a motion and a force vector, v x* f
+   */
+  inline SpatialVec ForceCross(const SpatialVec &v, const SpatialVec &f)
+  {
+    SpatialVec out;
+    out.head<3>() = v.head<3>().cross(f.head<3>()) + v.tail<3>().cross(f.tail<3>());
+    out.tail<3>() = v.head<3>().cross(f.tail<3>());
+    return out;
+  }
+
+  /**
+   * @brief Spatial inertia about a frame origin of a body with mass, center of
+   *        mass and rotational inertia about the center of mass, all in that frame
+   */
+  inline SpatialMat SpatialInertia(double mass, const SpatialVec3 &com, const SpatialMat3 &inertia_com)
+  {
+    SpatialMat3 c = Skew(com);
+    SpatialMat out;
+    out.topLeftCorner<3, 3>() = inertia_com + mass * c * c.transpose();
+    out.topRightCorner<3, 3>() = mass * c;
+    out.bottomLeftCorner<3, 3>() = mass * c.transpose();
+    out.bottomRightCorner<3, 3>() = mass * SpatialMat3::Identity();
+    return out;
+  }
+
+  /**
+   * @brief Plucker transform from frame A to frame B, B is A rotated by
+   *        E^T and moved to r, E maps A coordinates to B coordinates and r
+   *        is the origin of B in A coordinates
+   */
+  struct SpatialTransform
+  {
+    SpatialMat3 E = SpatialMat3::Identity();
+    SpatialVec3 r = SpatialVec3::Zero();
+
+    SpatialTransform() {}
+    SpatialTransform(const SpatialMat3 &rotation, const SpatialVec3 &translation) : E(rotation), r(translation) {}
+
+    /**
+     * @brief Frame B of a URDF origin, rotated by R and moved to p in frame A
+     */
+    static SpatialTransform FromPose(const SpatialMat3 &R, const SpatialVec3 &p) {return SpatialTransform(R.transpose(), p);}
+
+    /**
+     * @brief Motion vector in A coordinates to B coordinates
+     */
+    SpatialVec Apply(const SpatialVec &m) const
+    {
+      SpatialVec out;
+      out.head<3>() = E * m.head<3>();
+      out.tail<3>() = E * (m.tail<3>() - r.cross(m.head<3>()));
+      return out;
+    }
+
+    /**
+     * @brief Force vector in B coordinates to A coordinates
+     */
+    SpatialVec ApplyTranspose(const SpatialVec &f) const
+    {
+      SpatialVec out;
+      out.tail<3>() = E.transpose() * f.tail<3>();
+      out.head<3>() = E.transpose() * f.head<3>() + r.cross(out.tail<3>());
+      return out;
+    }
+
+    /**
+     * @brief Spatial inertia in B coordinates to A coordinates, X^T I X
+     */
+    SpatialMat TransformInertia(const SpatialMat &I) const
+    {
+      SpatialMat X = Matrix();
+      return X.transpose() * I * X;
+    }
+
+    /**
+     * @brief Transform from A to C, applying this one after other from Z to A
+     */
+    SpatialTransform operator*(const SpatialTransform &other) const
+    {
+      return SpatialTransform(E * other.E, other.r + other.E.transpose() * r);
+    }
+
+    SpatialTransform Inverse() const
+    {
+      return SpatialTransform(E.transpose(), -E * r);
+    }
+
+    SpatialMat Matrix() const
+    {
+      SpatialMat X;
+      X.topLeftCorner<3, 3>() = E;
+      X.topRightCorner<3, 3>().setZero();
+      X.bottomLeftCorner<3, 3>() = -E * Skew(r);
+      X.bottomRightCorner<3, 3>() = E;
+      return X;
+    }
+  };
+}
+
+#endif //_SPATIAL_HPP__
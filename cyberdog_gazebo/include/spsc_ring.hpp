@@ -0,0 +1,139 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _SPSC_RING_HPP__
+#define _SPSC_RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+
+namespace gazebo
+{
+  /**
+   * @brief Lock-free ring for one producer and one consumer thread.
+   *        Slots are preallocated, push and pop copy a T and never block
+   *
+   * @tparam T element type
+   * @tparam N capacity, a power of two
+   */
+  template <typename T, size_t N>
+  class SpscRing
+  {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+  public:
+    /**
+     * @brief Copy an element into the ring, called by the producer
+     *
+     * @param value
+     * @return false the ring is full, value is dropped
+     */
+    bool TryPush(const T &value)
+    {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_.load(std::memory_order_acquire) == N) {
+        return false;
+      }
+      slots_[tail & (N - 1)] = value;
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Copy the oldest element out of the ring, called by the consumer
+     *
+     * @param value
+     * @return false the ring is empty
+     */
+    bool TryPop(T &value)
+    {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      value = slots_[head & (N - 1)];
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Number of elements in the ring, exact only from the producer or consumer
+     *
+     * @return size_t
+     */
+    size_t Size() const
+    {
+      return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+  private:
+    // producer and consumer indices a cache line apart, padded rather than
+    // aligned so the ring may live in objects allocated with plain new
+    std::atomic<size_t> head_{0};
+    char head_pad_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_{0};
+    char tail_pad_[64 - sizeof(std::atomic<size_t>)];
+    T slots_[N];
+  };
+
+  /**
+   * @brief Lock-free latest value mailbox for one producer and one consumer
+   *        thread. A triple buffer, the producer overwrites unread values and
+   *        neither side ever waits for the other
+   *
+   * @tparam T value type
+   */
+  template <typename T>
+  class SpscMailbox
+  {
+  public:
+    /**
+     * @brief Publish a value, replacing one the consumer has not taken yet
+     *
+     * @param value
+     */
+    void Put(const T &value)
+    {
+      slots_[back_] = value;
+      back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    /**
+     * @brief Copy out the latest value if one was put since the last take
+     *
+     * @param value
+     * @return false nothing new, value is untouched
+     */
+    bool Take(T &value)
+    {
+      if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+        return false;
+      }
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+      value = slots_[front_];
+      return true;
+    }
+
+  private:
+    static constexpr unsigned kIndex = 3;
+    static constexpr unsigned kFresh = 4;
+
+    // the middle slot index is handed back and forth, the fresh bit marks an unread value
+    std::atomic<unsigned> middle_{1};
+    unsigned front_ = 0;
+    unsigned back_ = 2;
+    T slots_[3];
+  };
+}
+
+#endif //_SPSC_RING_HPP__
@@ -0,0 +1,360 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _TICK_PROFILER_HPP__
+#define _TICK_PROFILER_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace gazebo
+{
+  /**
+   * @brief Phases of a physics step as seen from LeggedPlugin, kPhysics is the
+   *        time between two OnUpdate calls and kTotal the whole OnUpdate
+   */
+  enum TickPhase
+  {
+    kPhysics,
+    kGetJointStates,
+    kApplyForce,
+    kControllerWait,
+    kSendSMData,
+    kSetJointCom,
+    kGetContactForce,
+    kSendSimData,
+    kReceiveTopic,
+    kTotal,
+    kNumTickPhases
+  };
+
+  static const char *const kTickPhaseNames[kNumTickPhases] = {
+    "physics", "get_joint_states", "apply_force", "controller_wait", "send_sm_data",
+    "set_joint_com", "get_contact_force", "send_sim_data", "receive_topic", "total"};
+
+  /**
+   * @brief Log-linear histogram of durations in nanoseconds, 16 buckets per
+   *        power of two keep every quantile within 6.25% up to 2^40 ns
+   */
+  class TickHistogram
+  {
+  public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxBits = 40;
+    static constexpr int kBuckets = 2 * kSubBuckets + (kMaxBits - kSubBits - 1) * kSubBuckets;
+
+    TickHistogram() {Reset();}
+
+    void Reset()
+    {
+      memset(counts_, 0, sizeof(counts_));
+      count_ = 0;
+      sum_ = 0;
+      max_ = 0;
+    }
+
+    void Record(uint64_t ns)
+    {
+      counts_[Bucket(ns)]++;
+      count_++;
+      sum_ += ns;
+      max_ = std::max(max_, ns);
+    }
+
+    /**
+     * @brief Add the samples of another histogram
+     *
+     * @param other
+     */
+    void Merge(const TickHistogram &other)
+    {
+      for (int i = 0; i < kBuckets; i++) {
+        counts_[i] += other.counts_[i];
+      }
+      count_ += other.count_;
+      sum_ += other.sum_;
+      max_ = std::max(max_, other.max_);
+    }
+
+    /**
+     * @brief Upper edge of the bucket holding the quantile q, exact max for q = 1
+     *
+     * @param q quantile in [0, 1]
+     * @return uint64_t nanoseconds
+     */
+    uint64_t Quantile(double q) const
+    {
+      if (count_ == 0) {
+        return 0;
+      }
+      uint64_t rank = std::max<uint64_t>(1, uint64_t(q * count_ + 0.5));
+      uint64_t seen = 0;
+      for (int i = 0; i < kBuckets; i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+          return std::min(max_, BucketUpper(i));
+        }
+      }
+      return max_;
+    }
+
+    uint64_t Count() const {return count_;}
+    uint64_t Max() const {return max_;}
+    double Mean() const {return count_ ? double(sum_) / count_ : 0.0;}
+    uint64_t BucketCount(int i) const {return counts_[i];}
+
+    static int Bucket(uint64_t ns)
+    {
+      if (ns < uint64_t(2 * kSubBuckets)) {
+        return int(ns);
+      }
+      int msb = std::min(63 - __builtin_clzll(ns), kMaxBits - 1);
+      if (msb == kMaxBits - 1 && (ns >> kMaxBits)) {
+        return kBuckets - 1;
+      }
+      return 2 * kSubBuckets + (msb - kSubBits - 1) * kSubBuckets + int((ns >> (msb - kSubBits)) & (kSubBuckets - 1));
+    }
+
+    static uint64_t BucketLower(int i)
+    {
+      if (i < 2 * kSubBuckets) {
+        return uint64_t(i);
+      }
+      int msb = (i - 2 * kSubBuckets) / kSubBuckets + kSubBits + 1;
+      uint64_t sub = uint64_t((i - 2 * kSubBuckets) % kSubBuckets);
+      return (uint64_t(kSubBuckets) + sub) << (msb - kSubBits);
+    }
+
+    static uint64_t BucketUpper(int i)
+    {
+      return i + 1 < kBuckets ? BucketLower(i + 1) - 1 : ~uint64_t(0);
+    }
+
+  private:
+    uint64_t counts_[kBuckets];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+  };
+
+  /**
+   * @brief Per-phase timing of LeggedPlugin::OnUpdate. Only the physics thread
+   *        records and reads it, one clock read per phase boundary. Without
+   *        LEGGED_PLUGIN_PROFILER every method is empty and compiles away
+   */
+  class TickProfiler
+  {
+  public:
+    /**
+     * @brief Turn recording on, it is off by default
+     *
+     * @param enabled
+     */
+    void Enable(bool enabled)
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      enabled_ = enabled;
+#else
+      (void)enabled;
+#endif
+    }
+
+    bool Enabled() const
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      return enabled_;
+#else
+      return false;
+#endif
+    }
+
+    /**
+     * @brief Start of OnUpdate, the time since the previous End is physics
+     *
+     */
+    void Start()
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      if (!enabled_) {
+        return;
+      }
+      uint64_t now = Now();
+      if (end_ > 0) {
+        interval_[kPhysics].Record(now - end_);
+      }
+      else {
+        rolled_ = now;
+      }
+      start_ = last_ = now;
+      memset(tick_, 0, sizeof(tick_));
+      ran_ = 0;
+#endif
+    }
+
+    /**
+     * @brief Charge the time since the previous mark to a phase
+     *
+     * @param phase
+     */
+    void Mark(TickPhase phase)
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      if (!enabled_) {
+        return;
+      }
+      uint64_t now = Now();
+      tick_[phase] += now - last_;
+      ran_ |= 1u << phase;
+      last_ = now;
+#else
+      (void)phase;
+#endif
+    }
+
+    /**
+     * @brief Skip the time since the previous mark, it belongs to no phase
+     *
+     */
+    void Skip()
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      if (enabled_) {
+        last_ = Now();
+      }
+#endif
+    }
+
+    /**
+     * @brief End of OnUpdate, records every phase that ran in this step
+     *
+     */
+    void End()
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      if (!enabled_) {
+        return;
+      }
+      end_ = Now();
+      for (int i = kGetJointStates; i < kTotal; i++) {
+        if (ran_ & (1u << i)) {
+          interval_[i].Record(tick_[i]);
+        }
+      }
+      interval_[kTotal].Record(end_ - start_);
+#endif
+    }
+
+    /**
+     * @brief Whether period_ns passed since the last Roll
+     *
+     * @param period_ns
+     */
+    bool Due(uint64_t period_ns) const
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      return enabled_ && end_ - rolled_ >= period_ns;
+#else
+      (void)period_ns;
+      return false;
+#endif
+    }
+
+    /**
+     * @brief Fold the histograms of the current report period into the run
+     *        totals and start a new period
+     *
+     * @return double length of the finished period in seconds
+     */
+    double Roll()
+    {
+#ifdef LEGGED_PLUGIN_PROFILER
+      double period = (end_ - rolled_) * 1e-9;
+      for (int i = 0; i < kNumTickPhases; i++) {
+        total_[i].Merge(interval_[i]);
+        last_interval_[i] = interval_[i];
+        interval_[i].Reset();
+      }
+      rolled_ = end_;
+      return period;
+#else
+      return 0.0;
+#endif
+    }
+
+    /**
+     * @brief Histogram of a phase over the report period finished by the last Roll
+     *
+     * @param phase
+     */
+    const TickHistogram &Interval(TickPhase phase) const {return last_interval_[phase];}
+
+    /**
+     * @brief Histogram of a phase over the whole run up to the last Roll
+     *
+     * @param phase
+     */
+    const TickHistogram &Total(TickPhase phase) const {return total_[phase];}
+
+    /**
+     * @brief Write the non-empty buckets of the run totals as csv
+     *
+     * @param path
+     * @return false the file could not be written
+     */
+    bool Dump(const std::string &path) const
+    {
+      FILE *file = fopen(path.c_str(), "w");
+      if (!file) {
+        return false;
+      }
+      fprintf(file, "phase,lower_ns,upper_ns,count\n");
+      for (int i = 0; i < kNumTickPhases; i++) {
+        for (int b = 0; b < TickHistogram::kBuckets; b++) {
+          if (total_[i].BucketCount(b)) {
+            fprintf(file, "%s,%lu,%lu,%lu\n", kTickPhaseNames[i], (unsigned long)TickHistogram::BucketLower(b),
+                    (unsigned long)TickHistogram::BucketUpper(b), (unsigned long)total_[i].BucketCount(b));
+          }
+        }
+      }
+      fclose(file);
+      return true;
+    }
+
+  private:
+    static uint64_t Now()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+#ifdef LEGGED_PLUGIN_PROFILER
+    bool enabled_ = false;
+    uint64_t start_ = 0;
+    uint64_t last_ = 0;
+    uint64_t end_ = 0;
+    uint64_t rolled_ = 0;
+    uint64_t tick_[kNumTickPhases];
+    unsigned ran_ = 0;
+#endif
+    TickHistogram interval_[kNumTickPhases];
+    TickHistogram last_interval_[kNumTickPhases];
+    TickHistogram total_[kNumTickPhases];
+  };
+}
+
+#endif //_TICK_PROFILER_HPP__
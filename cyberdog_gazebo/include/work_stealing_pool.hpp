@@ -0,0 +1,206 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _WORK_STEALING_POOL_HPP__
+#define _WORK_STEALING_POOL_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gazebo
+{
+  /**
+   * @brief Fixed set of threads running parallel loops. A loop is cut into
+   *        chunks, every thread gets a contiguous share of them in its own
+   *        queue and works it front to back. A thread whose queue runs dry
+   *        steals from the back of the others, so uneven chunks even out
+   *        without a shared queue. The calling thread works as thread 0
+   */
+  class WorkStealingPool
+  {
+  public:
+    /**
+     * @brief Start the pool
+     *
+     * @param threads threads working a loop, the caller included, at least 1
+     */
+    explicit WorkStealingPool(int threads)
+    {
+      threads = std::max(1, threads);
+      for (int i = 0; i < threads; i++) {
+        queues_.emplace_back(new Queue);
+      }
+      for (int i = 1; i < threads; i++) {
+        workers_.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+      }
+    }
+
+    ~WorkStealingPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (std::thread &worker : workers_) {
+        worker.join();
+      }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    int Threads() const {return int(queues_.size());}
+
+    /**
+     * @brief Chunks taken from another thread's queue since the pool started
+     */
+    uint64_t Steals() const {return steals_.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief Run fn(begin, end) over [0, count) in chunks of grain and return
+     *        when all are done. Chunks run concurrently, fn must not throw
+     *
+     * @param count
+     * @param grain indices per chunk, at least 1
+     * @param fn
+     */
+    void ParallelFor(int count, int grain, const std::function<void(int, int)> &fn)
+    {
+      if (count <= 0) {
+        return;
+      }
+      grain = std::max(1, grain);
+      int chunks = (count + grain - 1) / grain;
+      if (Threads() == 1 || chunks == 1) {
+        fn(0, count);
+        return;
+      }
+
+      // no thread runs a chunk before it is queued, so the job can be set unlocked
+      job_ = &fn;
+      pending_.store(chunks, std::memory_order_relaxed);
+      int threads = Threads();
+      for (int t = 0; t < threads; t++) {
+        std::lock_guard<std::mutex> lock(queues_[t]->mutex);
+        for (int c = t * chunks / threads; c < (t + 1) * chunks / threads; c++) {
+          queues_[t]->ranges.push_back(Range{c * grain, std::min(count, (c + 1) * grain)});
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+      }
+      wake_.notify_all();
+
+      Drain(0);
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] {return pending_.load(std::memory_order_acquire) == 0;});
+    }
+
+  private:
+    struct Range
+    {
+      int begin;
+      int end;
+    };
+
+    struct Queue
+    {
+      std::mutex mutex;
+      std::deque<Range> ranges;
+    };
+
+    void WorkerLoop(int id)
+    {
+      uint64_t seen = 0;
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          wake_.wait(lock, [&] {return stop_ || generation_ != seen;});
+          if (stop_) {
+            return;
+          }
+          seen = generation_;
+        }
+        Drain(id);
+      }
+    }
+
+    /**
+     * @brief Run chunks of the own queue, then stolen ones, until every queue is empty
+     */
+    void Drain(int id)
+    {
+      Range range;
+      while (Pop(id, range) || Steal(id, range)) {
+        (*job_)(range.begin, range.end);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          done_.notify_all();
+        }
+      }
+    }
+
+    bool Pop(int id, Range &range)
+    {
+      Queue &queue = *queues_[id];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.ranges.empty()) {
+        return false;
+      }
+      range = queue.ranges.front();
+      queue.ranges.pop_front();
+      return true;
+    }
+
+    bool Steal(int id, Range &range)
+    {
+      int threads = Threads();
+      for (int i = 1; i < threads; i++) {
+        Queue &victim = *queues_[(id + i) % threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ranges.empty()) {
+          range = victim.ranges.back();
+          victim.ranges.pop_back();
+          steals_.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // one queue per thread, each its own allocation so the locks do not share a line
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    const std::function<void(int, int)> *job_ = nullptr;
+    std::atomic<int> pending_{0};
+    std::atomic<uint64_t> steals_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+  };
+}
+
+#endif //_WORK_STEALING_POOL_HPP__
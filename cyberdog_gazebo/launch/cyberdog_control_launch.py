@@ -32,6 +32,11 @@ def generate_launch_description():
     # cd 
     # open_cmd = os.path.join("cd ", cmd_path)
     open_cmd = "cd " + cmd_path + " && ./cyberdog_control m s"
+
+    # follow the simulator instance selected by CYBERDOG_SIM_INSTANCE
+    instance = int(os.environ.get('CYBERDOG_SIM_INSTANCE', '0'))
+    if instance > 0:
+        open_cmd = "export LCM_DEFAULT_URL=udpm://239.255.76.67:" + str(7667 + instance) + "?ttl=0 && " + open_cmd
     print(open_cmd)
 
     os.system(open_cmd)
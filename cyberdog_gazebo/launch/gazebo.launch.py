@@ -21,7 +21,7 @@ from launch.conditions import IfCondition, UnlessCondition
 from launch.launch_description_sources import PythonLaunchDescriptionSource
 from launch.substitutions import Command, LaunchConfiguration, PythonExpression
 from launch.actions import DeclareLaunchArgument, IncludeLaunchDescription
-from launch.actions import OpaqueFunction
+from launch.actions import OpaqueFunction, SetEnvironmentVariable
 from ament_index_python.packages import get_package_prefix
 from ament_index_python.packages import get_package_share_directory
 import xacro
@@ -38,12 +38,35 @@ def launch_setup(context, *args, **kwargs):
     use_lidar = LaunchConfiguration('use_lidar').perform(context)
     wname = LaunchConfiguration('wname').perform(context)
     rname = LaunchConfiguration('rname').perform(context)
+    instance = int(LaunchConfiguration('instance').perform(context))
+    lockstep = LaunchConfiguration('lockstep').perform(context)
+    rt_priority = LaunchConfiguration('rt_priority').perform(context)
+    sim_cpus = LaunchConfiguration('sim_cpus').perform(context)
+    controller_cpus = LaunchConfiguration('controller_cpus').perform(context)
+    lock_memory = LaunchConfiguration('lock_memory').perform(context)
+    controller_library = LaunchConfiguration('controller_library').perform(context)
+    controller_args = LaunchConfiguration('controller_args').perform(context)
 
     # env
     my_env = os.environ.copy()
     my_env["GAZEBO_MODEL_PATH"] = os.path.join(pkg_share, 'model')
     my_env["GAZEBO_PLUGIN_PATH"] = os.path.join(get_package_prefix('cyberdog_gazebo'), 'lib')
 
+    # instance n > 0 gets its own gazebo master, lcm port and ros namespace,
+    # the controller must be started with the same CYBERDOG_SIM_INSTANCE
+    instance_env = []
+    ros_namespace = ''
+    extra_gazebo_args = ''
+    if instance > 0:
+        ros_namespace = '/sim' + str(instance)
+        extra_gazebo_args = '--ros-args -r __ns:=' + ros_namespace
+        for key, value in {
+                'CYBERDOG_SIM_INSTANCE': str(instance),
+                'GAZEBO_MASTER_URI': 'http://localhost:' + str(11345 + instance),
+                'LCM_DEFAULT_URL': 'udpm://239.255.76.67:' + str(7667 + instance) + '?ttl=0'}.items():
+            my_env[key] = value
+            instance_env.append(SetEnvironmentVariable(key, value))
+
     # world
     world_path = os.path.join(pkg_share, 'world', wname+'.world')
 
@@ -51,13 +74,16 @@ def launch_setup(context, *args, **kwargs):
     xacro_path = os.path.join(get_package_share_directory(
         rname+'_description'), 'xacro', 'robot.xacro')
     urdf_contents = xacro.process_file(xacro_path, mappings={
-                                       'DEBUG': hang_robot, 'USE_LIDAR': use_lidar}).toprettyxml(indent='  ')
+                                       'DEBUG': hang_robot, 'USE_LIDAR': use_lidar, 'INSTANCE': str(instance), 'LOCKSTEP': lockstep,
+                                       'RT_PRIORITY': rt_priority, 'SIM_CPUS': sim_cpus, 'CONTROLLER_CPUS': controller_cpus,
+                                       'LOCK_MEMORY': lock_memory,
+                                       'CONTROLLER_LIBRARY': controller_library, 'CONTROLLER_ARGS': controller_args}).toprettyxml(indent='  ')
 
     # spawn
     spawn_entity_message_contents = "'{initial_pose:{ position: {x: 0, y: 0, z: 0.31}, orientation: {x: 0.0, y: 0.0, z: 0.0, w: 1.0}},  name: \""+ rname + "\", xml: \"" + \
         urdf_contents.replace('"', '\\"') + "\"}'"
     spawn_entity = launch.actions.ExecuteProcess(
-        name='spawn_entity', cmd=['ros2', 'service', 'call', '/spawn_entity', 'gazebo_msgs/SpawnEntity', spawn_entity_message_contents], env=my_env, shell=True, log_cmd=False)
+        name='spawn_entity', cmd=['ros2', 'service', 'call', ros_namespace + '/spawn_entity', 'gazebo_msgs/SpawnEntity', spawn_entity_message_contents], env=my_env, shell=True, log_cmd=False)
 
     # gazebo server
     start_gazebo_server_cmd = IncludeLaunchDescription(
@@ -71,6 +97,7 @@ def launch_setup(context, *args, **kwargs):
             'paused': LaunchConfiguration('paused'),
             'use_sim_time': LaunchConfiguration('use_sim_time'),
             'headless': LaunchConfiguration('headless'),
+            'extra_gazebo_args': extra_gazebo_args,
             'env': my_env
         }.items()
     )
@@ -83,7 +110,7 @@ def launch_setup(context, *args, **kwargs):
             [LaunchConfiguration('use_simulator'), ' and not ', LaunchConfiguration('headless')]))
     )
 
-    return [
+    return instance_env + [
         start_gazebo_server_cmd,
         start_gazebo_client_cmd,
         spawn_entity]
@@ -133,6 +160,46 @@ def generate_launch_description():
             name='wname',
             default_value='simple'
         ),
+        DeclareLaunchArgument(
+            name='instance',
+            default_value='0',
+            description='Simulator instance, n > 0 isolates this simulator from others on the host'
+        ),
+        DeclareLaunchArgument(
+            name='lockstep',
+            default_value='false',
+            description='Run as fast as the controller allows instead of real time'
+        ),
+        DeclareLaunchArgument(
+            name='rt_priority',
+            default_value='0',
+            description='SCHED_FIFO priority of the physics thread and the controller, 0 keeps the default scheduler'
+        ),
+        DeclareLaunchArgument(
+            name='sim_cpus',
+            default_value='',
+            description='Cpus of the physics thread, e.g. 2 or 2-3'
+        ),
+        DeclareLaunchArgument(
+            name='controller_cpus',
+            default_value='',
+            description='Cpus recommended to the controller through the shared memory'
+        ),
+        DeclareLaunchArgument(
+            name='lock_memory',
+            default_value='false',
+            description='Lock the gazebo process memory'
+        ),
+        DeclareLaunchArgument(
+            name='controller_library',
+            default_value='',
+            description='Controller shared library to run inside gzserver, e.g. libcontroller_stand_in.so, empty for the shared memory'
+        ),
+        DeclareLaunchArgument(
+            name='controller_args',
+            default_value='',
+            description='Arguments of the controller library'
+        ),
         OpaqueFunction(function=launch_setup)
     ])
     return ld
@@ -0,0 +1,179 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch_simulator.hpp"
+
+using namespace gazebo;
+
+namespace
+{
+  struct BenchmarkConfig
+  {
+    std::string urdf;
+    int envs = 256;
+    int iterations = 200;         // Step calls, each a control tick
+    int decimation = 4;           // physics steps per Step call
+    double dt = 0.0005;
+    int grain = 1;
+    std::vector<int> threads;     // thread counts to measure
+  };
+
+  /**
+   * @brief Drop every environment from a slightly different height and yaw
+   *        onto a joint space PD stand, so contacts begin at different steps
+   */
+  void ResetEnvironments(BatchSimulator &simulator)
+  {
+    const double q_stand[3] = {0.0, -0.75, 1.5};
+    double q[12];
+    for (int i = 0; i < 12; i++) {
+      q[i] = q_stand[i % 3];
+    }
+    BatchCommand &command = simulator.Command();
+    for (int env = 0; env < simulator.Envs(); env++) {
+      double spread = simulator.Envs() > 1 ? double(env) / (simulator.Envs() - 1) : 0.0;
+      simulator.Reset(env, SpatialVec3(0, 0, 0.25 + 0.1 * spread),
+                      Eigen::Quaterniond(Eigen::AngleAxisd(M_PI * spread, Eigen::Vector3d::UnitZ())), q);
+      for (int i = 0; i < 12; i++) {
+        command.q_des[env * 12 + i] = q[i];
+        command.kp[env * 12 + i] = 60;
+        command.kd[env * 12 + i] = 1.5;
+      }
+    }
+  }
+
+  bool ParseThreads(const std::string &list, std::vector<int> &threads)
+  {
+    threads.clear();
+    const char *p = list.c_str();
+    while (*p) {
+      char *end;
+      long count = strtol(p, &end, 10);
+      if (end == p || count < 1) {
+        return false;
+      }
+      if (*end && *end != ',') {
+        return false;
+      }
+      threads.push_back(int(count));
+      p = *end == ',' ? end + 1 : end;
+    }
+    return !threads.empty();
+  }
+
+  void Usage(const char *program)
+  {
+    printf("Usage: %s --urdf FILE [options]\n"
+           "  --urdf FILE       robot description, e.g. xacro cyberdog_description/xacro/robot.xacro > cyberdog.urdf\n"
+           "  --envs N          environments stepped together (default 256)\n"
+           "  --iterations N    batch steps to time (default 200)\n"
+           "  --decimation N    physics steps per batch step (default 4)\n"
+           "  --dt S            physics step (default 0.0005)\n"
+           "  --grain N         environments per chunk of work (default 1)\n"
+           "  --threads LIST    thread counts to measure, e.g. 1,2,4 (default powers of two up to the core count)\n",
+           program);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  BenchmarkConfig config;
+  const struct option options[] = {
+    {"urdf", required_argument, nullptr, 'u'},
+    {"envs", required_argument, nullptr, 'e'},
+    {"iterations", required_argument, nullptr, 'I'},
+    {"decimation", required_argument, nullptr, 'n'},
+    {"dt", required_argument, nullptr, 't'},
+    {"grain", required_argument, nullptr, 'g'},
+    {"threads", required_argument, nullptr, 'j'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 'u': config.urdf = optarg; break;
+      case 'e': config.envs = std::max(1, atoi(optarg)); break;
+      case 'I': config.iterations = std::max(1, atoi(optarg)); break;
+      case 'n': config.decimation = std::max(1, atoi(optarg)); break;
+      case 't': config.dt = atof(optarg); break;
+      case 'g': config.grain = std::max(1, atoi(optarg)); break;
+      case 'j':
+        if (!ParseThreads(optarg, config.threads)) {
+          printf("[Batch] %s is not a list of thread counts\n", optarg);
+          return 1;
+        }
+        break;
+      default:
+        Usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (config.urdf.empty() || config.dt <= 0) {
+    Usage(argv[0]);
+    return 1;
+  }
+  if (config.threads.empty()) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int count = 1; count < cores; count *= 2) {
+      config.threads.push_back(count);
+    }
+    config.threads.push_back(cores);
+  }
+
+  RigidBodyModel model;
+  std::string error;
+  if (!model.Load(config.urdf, error)) {
+    printf("[Batch] %s: %s\n", config.urdf.c_str(), error.c_str());
+    return 1;
+  }
+  printf("[Batch] %d environments, %d x %d steps of %g s, %u cores\n", config.envs, config.iterations,
+         config.decimation, config.dt, std::thread::hardware_concurrency());
+  printf("%8s %16s %9s %9s %12s\n", "threads", "env-steps/s", "speedup", "steals", "checksum");
+
+  double baseline = 0;
+  for (int threads : config.threads) {
+    BatchSimulator simulator(model, config.envs, threads);
+    simulator.SetGrain(config.grain);
+    ResetEnvironments(simulator);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.iterations; i++) {
+      simulator.Step(config.decimation, config.dt);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rate = double(config.envs) * config.iterations * config.decimation / std::max(wall, 1e-9);
+    if (baseline == 0) {
+      baseline = rate;
+    }
+
+    // environments are independent, the final state must not depend on the thread count
+    double checksum = 0;
+    for (double z : simulator.State().base_position) {
+      checksum += z;
+    }
+    printf("%8d %16.0f %8.2fx %9lu %12.6f\n", threads, rate, rate / baseline, (unsigned long)simulator.Steals(),
+           checksum);
+  }
+  return 0;
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batch_simulator.hpp"
+
+#include <algorithm>
+
+namespace gazebo
+{
+  BatchSimulator::BatchSimulator(const RigidBodyModel &model, int envs, int threads, const ContactParameters &contact)
+  : model_(model), pool_(threads)
+  {
+    envs = std::max(0, envs);
+    for (int env = 0; env < envs; env++) {
+      envs_.emplace_back(new Environment(model, contact));
+    }
+    for (std::vector<double> *field : {&command_.q_des, &command_.qd_des, &command_.kp, &command_.kd, &command_.tau_ff,
+                                       &state_.q, &state_.qd, &state_.tau, &state_.foot_force}) {
+      field->assign(envs * 12, 0.0);
+    }
+    for (std::vector<double> *field : {&state_.base_position, &state_.base_linear_velocity,
+                                       &state_.base_angular_velocity}) {
+      field->assign(envs * 3, 0.0);
+    }
+    state_.base_orientation.assign(envs * 4, 0.0);
+    state_.time.assign(envs, 0.0);
+    for (int env = 0; env < envs; env++) {
+      Reset(env, SpatialVec3::Zero(), Eigen::Quaterniond::Identity());
+    }
+  }
+
+  void BatchSimulator::Reset(int env, const SpatialVec3 &position, const Eigen::Quaterniond &orientation, const double *q)
+  {
+    Environment &environment = *envs_[env];
+    double q_body[RigidBodyModel::kMaxBodies] = {};
+    if (q) {
+      for (int i = 0; i < 12; i++) {
+        q_body[model_.ControlJointBody(i)] = model_.ControlJointSign(i) * q[i];
+      }
+    }
+    environment.dynamics.Reset(position, orientation, q_body);
+    environment.motor = ActuatorBatch();
+    std::fill(environment.tau, environment.tau + RigidBodyModel::kMaxBodies, 0.0);
+    for (std::vector<double> *field : {&command_.q_des, &command_.qd_des, &command_.kp, &command_.kd, &command_.tau_ff}) {
+      std::fill(field->begin() + env * 12, field->begin() + env * 12 + 12, 0.0);
+    }
+    Gather(env);
+  }
+
+  void BatchSimulator::Step(int steps, double dt)
+  {
+    pool_.ParallelFor(Envs(), grain_, [&](int begin, int end) {
+      for (int env = begin; env < end; env++) {
+        StepEnvironment(env, steps, dt);
+        Gather(env);
+      }
+    });
+  }
+
+  void BatchSimulator::StepEnvironment(int env, int steps, double dt)
+  {
+    Environment &environment = *envs_[env];
+    RigidBodyDynamics &dynamics = environment.dynamics;
+    const int base = env * 12;
+
+    // The command is held for all steps, pack it for the spine boards once
+    SpiCommand &cmd = environment.cmd;
+    float *q_des[3] = {cmd.q_des_abad, cmd.q_des_hip, cmd.q_des_knee};
+    float *qd_des[3] = {cmd.qd_des_abad, cmd.qd_des_hip, cmd.qd_des_knee};
+    float *kp[3] = {cmd.kp_abad, cmd.kp_hip, cmd.kp_knee};
+    float *kd[3] = {cmd.kd_abad, cmd.kd_hip, cmd.kd_knee};
+    float *tau_ff[3] = {cmd.tau_abad_ff, cmd.tau_hip_ff, cmd.tau_knee_ff};
+    for (int i = 0; i < 12; i++) {
+      q_des[i % 3][i / 3] = float(command_.q_des[base + i]);
+      qd_des[i % 3][i / 3] = float(command_.qd_des[base + i]);
+      kp[i % 3][i / 3] = float(command_.kp[base + i]);
+      kd[i % 3][i / 3] = float(command_.kd[base + i]);
+      tau_ff[i % 3][i / 3] = float(command_.tau_ff[base + i]);
+    }
+    for (int leg = 0; leg < 4; leg++) {
+      cmd.flags[leg] = 1;
+    }
+    environment.spine_board.cmd = &cmd;
+    environment.spine_board.data = &environment.spi_data;
+
+    SpiData &data = environment.spi_data;
+    float *q[3] = {data.q_abad, data.q_hip, data.q_knee};
+    float *qd[3] = {data.qd_abad, data.qd_hip, data.qd_knee};
+    for (int step = 0; step < steps; step++) {
+      // Spine boards and motor model as LeggedPlugin::SetJointCom and the headless simulator
+      ActuatorBatch::Array12d effort;
+      ActuatorBatch::Array12d joint_qd;
+      for (int i = 0; i < 12; i++) {
+        int body = model_.ControlJointBody(i);
+        double sign = model_.ControlJointSign(i);
+        q[i % 3][i / 3] = float(sign * dynamics.Q(body));
+        qd[i % 3][i / 3] = float(sign * dynamics.Qd(body));
+        joint_qd[i] = dynamics.Qd(body);
+      }
+      environment.spine_board.run();
+      for (int i = 0; i < 12; i++) {
+        effort[i] = model_.ControlJointSign(i) * environment.spine_board.torque_out[i % 3][i / 3];
+      }
+      environment.motor.GetTorque(effort, joint_qd);
+      environment.motor.CurrentLoopResponse(effort);
+      for (int i = 0; i < 12; i++) {
+        environment.tau[model_.ControlJointBody(i)] = effort[i];
+      }
+      dynamics.Step(environment.tau, dt);
+    }
+  }
+
+  void BatchSimulator::Gather(int env)
+  {
+    const RigidBodyDynamics &dynamics = envs_[env]->dynamics;
+    state_.time[env] = dynamics.Time();
+    for (int i = 0; i < 12; i++) {
+      int body = model_.ControlJointBody(i);
+      double sign = model_.ControlJointSign(i);
+      state_.q[env * 12 + i] = sign * dynamics.Q(body);
+      state_.qd[env * 12 + i] = sign * dynamics.Qd(body);
+      state_.tau[env * 12 + i] = sign * dynamics.Tau(body);
+    }
+
+    Eigen::Quaterniond orientation = dynamics.BaseOrientation();
+    SpatialVec3 linear = dynamics.BaseLinearVelocity();
+    SpatialVec3 angular = dynamics.BaseAngularVelocity();
+    for (int axis = 0; axis < 3; axis++) {
+      state_.base_position[env * 3 + axis] = dynamics.BasePosition()[axis];
+      state_.base_linear_velocity[env * 3 + axis] = linear[axis];
+      state_.base_angular_velocity[env * 3 + axis] = angular[axis];
+    }
+    state_.base_orientation[env * 4] = orientation.w();
+    state_.base_orientation[env * 4 + 1] = orientation.x();
+    state_.base_orientation[env * 4 + 2] = orientation.y();
+    state_.base_orientation[env * 4 + 3] = orientation.z();
+
+    for (int leg = 0; leg < 4; leg++) {
+      int contact = model_.FootContact(leg);
+      for (int axis = 0; axis < 3; axis++) {
+        state_.foot_force[env * 12 + leg * 3 + axis] = contact < 0 ? 0.0 : dynamics.ContactForce(contact)[axis];
+      }
+    }
+  }
+}
@@ -30,6 +30,8 @@ std::string ControlParameterRequestKindToString( ControlParameterRequestKind req
         return "get imu_calibrate";
     case ControlParameterRequestKind::kSET_IMU_CALIBRATE_PARAM_BY_NAME:
         return "set imu_calibrate";
+    case ControlParameterRequestKind::kSET_ALL_PARAMS:
+        return "set all";
     default:
         return "unknown";
     }
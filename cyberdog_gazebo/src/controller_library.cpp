@@ -0,0 +1,105 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dlfcn.h>
+
+#include "controller_library.hpp"
+
+namespace gazebo
+{
+    ControllerLibrary::~ControllerLibrary()
+    {
+        Unload();
+    }
+
+    bool ControllerLibrary::Load(const std::string &path, const std::string &args, SimulatorMessage &message, std::string &error)
+    {
+        Unload();
+        handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle_) {
+            error = dlerror();
+            return false;
+        }
+
+        AbiVersionFunction abi_version = (AbiVersionFunction)dlsym(handle_, "sim_controller_abi_version");
+        init_ = (InitFunction)dlsym(handle_, "sim_controller_init");
+        handle_parameter_ = (HandleParameterFunction)dlsym(handle_, "sim_controller_handle_parameter");
+        step_ = (StepFunction)dlsym(handle_, "sim_controller_step");
+        shutdown_ = (ShutdownFunction)dlsym(handle_, "sim_controller_shutdown");
+        if (!abi_version || !init_ || !handle_parameter_ || !step_ || !shutdown_) {
+            error = path + " does not export the sim_controller functions";
+            Unload();
+            return false;
+        }
+        if (abi_version() != SIM_CONTROLLER_ABI_VERSION) {
+            error = path + " implements controller ABI " + std::to_string(abi_version()) + ", the simulator " +
+                    std::to_string(SIM_CONTROLLER_ABI_VERSION);
+            Unload();
+            return false;
+        }
+
+        args_ = args;
+        if (!Restart(message)) {
+            error = "sim_controller_init of " + path + " failed";
+            Unload();
+            return false;
+        }
+        return true;
+    }
+
+    bool ControllerLibrary::Restart(SimulatorMessage &message)
+    {
+        if (controller_) {
+            shutdown_(controller_);
+        }
+        controller_ = init_(args_.c_str(), sizeof(SimulatorMessage), &message);
+        return controller_ != nullptr;
+    }
+
+    void ControllerLibrary::Unload()
+    {
+        if (controller_) {
+            shutdown_(controller_);
+            controller_ = nullptr;
+        }
+        if (handle_) {
+            dlclose(handle_);
+            handle_ = nullptr;
+        }
+    }
+
+    bool ControllerLibrary::Run(SimulatorMessage &message, ControlParameterTable *table)
+    {
+        switch (message.simToRobot.mode) {
+        case SimulatorMode::RUN_CONTROL_PARAMETERS:
+            return handle_parameter_(controller_, &message, table) == 0;
+
+        case SimulatorMode::RUN_CONTROLLER: {
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+            // stamped here, the library needs not know about the timing stats
+            message.robotToSim.tickStartTime = MonotonicNanoseconds();
+#endif
+            s32 result = step_(controller_, &message.simToRobot, &message.robotToSim);
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+            message.robotToSim.tickSequence = message.simToRobot.tickSequence;
+            message.robotToSim.tickEndTime = MonotonicNanoseconds();
+#endif
+            return result == 0;
+        }
+
+        default:
+            return true;
+        }
+    }
+}
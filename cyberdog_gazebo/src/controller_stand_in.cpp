@@ -0,0 +1,330 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <getopt.h>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+#include "controller_stand_in.hpp"
+#include "realtime.hpp"
+
+using namespace gazebo;
+
+namespace
+{
+  /**
+   * @brief Min, average, 99th percentile and max of a latency sample in microseconds
+   */
+  void PrintLatency(const char *what, std::vector<double> &samples)
+  {
+    if (samples.empty()) {
+      return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) {
+      sum += s;
+    }
+    printf("[Stand-in] %s over %ld samples: min %.2f avg %.2f p99 %.2f max %.2f us\n", what, samples.size(), samples.front(),
+           sum / samples.size(), samples[samples.size() * 99 / 100], samples.back());
+  }
+
+  /**
+   * @brief Spread of the intervals between control ticks around the control
+   *        period, the wake up jitter the controller sees
+   */
+  void PrintJitter(std::vector<double> &intervals, double period_us)
+  {
+    if (intervals.empty()) {
+      return;
+    }
+    double sum = 0, sum_sq = 0;
+    for (double &interval : intervals) {
+      interval = std::fabs(interval - period_us);
+      sum += interval;
+      sum_sq += interval * interval;
+    }
+    std::sort(intervals.begin(), intervals.end());
+    double mean = sum / intervals.size();
+    printf("[Stand-in] tick jitter around %.0f us: mean %.2f rms %.2f p99 %.2f max %.2f us\n", period_us, mean,
+           std::sqrt(sum_sq / intervals.size()), intervals[intervals.size() * 99 / 100], intervals.back());
+  }
+
+  /**
+   * @brief Apply a SCHED_FIFO priority and cpus to the calling thread and say so
+   */
+  void ApplyRealTime(int priority, uint64_t cpus)
+  {
+    if (cpus != 0) {
+      int error = SetThreadAffinity(cpus);
+      printf("[Stand-in] cpus %s: %s\n", CpuListString(cpus).c_str(), error ? strerror(error) : "ok");
+    }
+    if (priority > 0) {
+      int error = SetThreadFifo(priority);
+      printf("[Stand-in] SCHED_FIFO %d: %s\n", priority, error ? strerror(error) : "ok");
+    }
+  }
+
+  /**
+   * @brief Ping-pong an empty SimulatorMessage between two processes to measure
+   *        the round trip cost of a sync mode without a simulator
+   */
+  int RunPing(long count, SharedMemorySyncMode sync_mode)
+  {
+    SharedMemoryObject<SimulatorMessage> host;
+    std::string name = InstanceScopedName(DEVELOPMENT_SIMULATOR_SHARED_MEMORY_NAME "-ping", getpid());
+    host.CreateNew(name, true);
+    host.Init(true, sync_mode, getpid());
+
+    pid_t robot = fork();
+    if (robot == 0) {
+      SharedMemoryObject<SimulatorMessage> client;
+      client.Attach(name);
+      client.Init(false, sync_mode, getppid());
+      for (long i = 0; i < count; i++) {
+        client.WaitForSimulator();
+        client.RobotIsDone();
+      }
+      client.Detach();
+      _exit(0);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(count);
+    for (long i = 0; i < count; i++) {
+      auto start = std::chrono::steady_clock::now();
+      host.SimulatorIsDone();
+      host.WaitForRobot();
+      samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    waitpid(robot, nullptr, 0);
+    host.CloseNew();
+    if (sync_mode == SharedMemorySyncMode::kSemaphore) {
+      sem_unlink(InstanceScopedName("/robot2sim", getpid()).c_str());
+      sem_unlink(InstanceScopedName("/sim2robot", getpid()).c_str());
+    }
+
+    PrintLatency(sync_mode == SharedMemorySyncMode::kSeqlock ? "seqlock round trip" : "semaphore round trip", samples);
+    return 0;
+  }
+
+  /**
+   * @brief Print the controller timing block of a running simulator once per second
+   */
+  int RunStats(int instance)
+  {
+    SharedMemoryObject<ControllerTimingStats> stats;
+    stats.Attach(InstanceScopedName(DEVELOPMENT_SIMULATOR_STATS_SHARED_MEMORY_NAME, instance));
+    while (true) {
+      ControllerTiming t = stats().Read();
+      printf("[Stand-in] %lu ticks, %lu over the %.1f us deadline, %lu stale | round trip us: last %.2f min %.2f avg %.2f "
+             "p50 %.2f p99 %.2f p99.9 %.2f max %.2f | wake %.2f compute %.2f return %.2f\n",
+             t.ticks, t.deadlineMisses, t.deadlineNs * 1e-3, t.staleReplies, t.lastNs * 1e-3, t.ticks ? t.minNs * 1e-3 : 0.0,
+             t.avgNs * 1e-3, t.p50Ns * 1e-3, t.p99Ns * 1e-3, t.p999Ns * 1e-3, t.maxNs * 1e-3, t.avgWakeNs * 1e-3,
+             t.avgComputeNs * 1e-3, t.avgReturnNs * 1e-3);
+      sleep(1);
+    }
+    return 0;
+  }
+
+  void Usage(const char *program)
+  {
+    printf("Usage: %s [options]\n"
+           "  --instance N        simulator instance to attach to (default CYBERDOG_SIM_INSTANCE or 0)\n"
+           "  --mode stand|trot   joint space PD stand or trot in place (default stand)\n"
+           "  --kp K --kd D       joint PD gains\n"
+           "  --delay-us US       synthetic compute time per control tick\n"
+           "  --ticks N           exit after N control ticks\n"
+           "  --report N          print timing every N control ticks (default 5000)\n"
+           "  --ping N            measure N round trips of the sync primitive, no simulator needed\n"
+           "  --sync MODE         semaphore or seqlock for --ping (default semaphore)\n"
+           "  --stats             print the controller timing of a running simulator every second\n"
+           "  --priority P        SCHED_FIFO priority, default the simulator's recommendation\n"
+           "  --cpus LIST         cpus to run on, e.g. 3 or 2-3, default the simulator's recommendation\n",
+           program);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  StandInConfig config;
+  int instance = SimulatorInstanceFromEnv();
+  long max_ticks = -1;
+  long report_period = 5000;
+  long ping = 0;
+  bool stats = false;
+  int priority = -1;
+  uint64_t cpus = 0;
+  bool cpus_set = false;
+  SharedMemorySyncMode sync_mode = SharedMemorySyncMode::kSemaphore;
+
+  const struct option options[] = {
+    {"instance", required_argument, nullptr, 'i'},
+    {"mode", required_argument, nullptr, 'm'},
+    {"kp", required_argument, nullptr, 'p'},
+    {"kd", required_argument, nullptr, 'd'},
+    {"delay-us", required_argument, nullptr, 'D'},
+    {"ticks", required_argument, nullptr, 'n'},
+    {"report", required_argument, nullptr, 'r'},
+    {"ping", required_argument, nullptr, 'P'},
+    {"sync", required_argument, nullptr, 's'},
+    {"stats", no_argument, nullptr, 'S'},
+    {"priority", required_argument, nullptr, 'F'},
+    {"cpus", required_argument, nullptr, 'c'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "i:m:p:d:D:n:r:P:s:SF:c:h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 'i': instance = atoi(optarg); break;
+      case 'm': config.mode = std::string(optarg) == "trot" ? StandInMode::TROT : StandInMode::STAND; break;
+      case 'p': config.kp = atof(optarg); break;
+      case 'd': config.kd = atof(optarg); break;
+      case 'D': config.compute_delay_ns = atol(optarg) * 1000; break;
+      case 'n': max_ticks = atol(optarg); break;
+      case 'r': report_period = std::max(1L, atol(optarg)); break;
+      case 'P': ping = atol(optarg); break;
+      case 's': sync_mode = std::string(optarg) == "seqlock" ? SharedMemorySyncMode::kSeqlock : SharedMemorySyncMode::kSemaphore; break;
+      case 'S': stats = true; break;
+      case 'F': priority = std::max(0, atoi(optarg)); break;
+      case 'c':
+        if (!ParseCpuList(optarg, cpus)) {
+          printf("[Stand-in] bad cpu list %s\n", optarg);
+          return 1;
+        }
+        cpus_set = true;
+        break;
+      default: Usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (ping > 0) {
+    // the robot side inherits the scheduling across fork
+    ApplyRealTime(std::max(0, priority), cpus);
+    return RunPing(ping, sync_mode);
+  }
+  if (stats) {
+    return RunStats(instance);
+  }
+
+  // the simulator may come up after us, wait for it to create the sharedmemory
+  SharedMemoryObject<SimulatorMessage> shared_memory;
+  std::string name = InstanceScopedName(DEVELOPMENT_SIMULATOR_SHARED_MEMORY_NAME, instance);
+  while (true) {
+    try {
+      shared_memory.Attach(name);
+      break;
+    }
+    catch (const std::runtime_error &) {
+      printf("[Stand-in] waiting for simulator to create %s...\n", name.c_str());
+      sleep(1);
+    }
+  }
+  shared_memory.Init(false, SharedMemorySyncMode::kSemaphore, instance);
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+  shared_memory().robotToSim.controlParameterTableSupport = kCONTROL_PARAMETER_TABLE_MAGIC;
+  // attached once the simulator has created it for its first kSET_ALL_PARAMS
+  SharedMemoryObject<ControlParameterTable> parameter_table;
+  bool parameter_table_attached = false;
+#endif
+  ControlParameterTable *table = nullptr;
+
+  StandInController controller(config);
+  std::vector<double> waits;
+  std::vector<double> intervals;
+  waits.reserve(report_period);
+  intervals.reserve(report_period);
+  std::chrono::steady_clock::time_point last_tick;
+  bool realtime_applied = false;
+  auto report_start = std::chrono::steady_clock::now();
+  bool running = true;
+
+  while (running) {
+    auto wait_start = std::chrono::steady_clock::now();
+    shared_memory.WaitForSimulator();
+    auto wait_end = std::chrono::steady_clock::now();
+
+    // the simulator's recommendation is in place once it talks to us
+    if (!realtime_applied) {
+      realtime_applied = true;
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+      if (priority < 0) {
+        priority = shared_memory().simToRobot.controllerPriority;
+      }
+      if (!cpus_set) {
+        cpus = shared_memory().simToRobot.controllerAffinity;
+      }
+#endif
+      ApplyRealTime(std::max(0, priority), cpus);
+    }
+
+    switch (shared_memory().simToRobot.mode) {
+      case SimulatorMode::RUN_CONTROL_PARAMETERS:
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        if (!parameter_table_attached && shared_memory().simToRobot.controlParameterTableEnabled) {
+          parameter_table.Attach(InstanceScopedName(DEVELOPMENT_SIMULATOR_PARAMETER_TABLE_SHARED_MEMORY_NAME, instance));
+          parameter_table_attached = true;
+          table = &parameter_table();
+        }
+#endif
+        controller.HandleControlParameters(shared_memory(), table);
+        break;
+      case SimulatorMode::RUN_CONTROLLER:
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        // stamp the answer so the simulator can tell wake up from compute time
+        shared_memory().robotToSim.tickStartTime = MonotonicNanoseconds();
+#endif
+        controller.RunController(shared_memory().simToRobot, shared_memory().robotToSim.spiCommand);
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        shared_memory().robotToSim.tickSequence = shared_memory().simToRobot.tickSequence;
+        shared_memory().robotToSim.tickEndTime = MonotonicNanoseconds();
+#endif
+        waits.push_back(std::chrono::duration<double, std::micro>(wait_end - wait_start).count());
+        if (controller.Iterations() > 1) {
+          intervals.push_back(std::chrono::duration<double, std::micro>(wait_end - last_tick).count());
+        }
+        last_tick = wait_end;
+        break;
+      case SimulatorMode::EXIT:
+        running = false;
+        break;
+      default:
+        break;
+    }
+    shared_memory.RobotIsDone();
+
+    // time spent waiting is the simulator's share of every control tick
+    if ((long)waits.size() >= report_period) {
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - report_start).count();
+      printf("[Stand-in] %ld ticks, %.0f ticks/s, real time factor %.2f\n", controller.Iterations(), waits.size() / seconds,
+             waits.size() * config.dt / seconds);
+      PrintLatency("simulator step", waits);
+      PrintJitter(intervals, config.dt * 1e6);
+      waits.clear();
+      intervals.clear();
+      report_start = std::chrono::steady_clock::now();
+    }
+    if (max_ticks >= 0 && controller.Iterations() >= max_ticks) {
+      running = false;
+    }
+  }
+
+  shared_memory.Detach();
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+#include "controller_stand_in.hpp"
+#include "sim_utilities/controller_library_interface.hpp"
+
+// The stand-in controller behind the in-process C ABI, e.g.
+// <controllerLibrary>libcontroller_stand_in.so</controllerLibrary>
+// <controllerArgs>mode=trot kp=60 kd=1.5</controllerArgs>
+
+using namespace gazebo;
+
+extern "C" {
+
+u32 sim_controller_abi_version(void)
+{
+  return SIM_CONTROLLER_ABI_VERSION;
+}
+
+void *sim_controller_init(const char *args, u64 message_size, SimulatorMessage *message)
+{
+  if (message_size != sizeof(SimulatorMessage)) {
+    printf("[Stand-in] SimulatorMessage is %lu bytes in the simulator, %lu here\n", (unsigned long)message_size,
+           (unsigned long)sizeof(SimulatorMessage));
+    return nullptr;
+  }
+
+  StandInConfig config;
+  std::istringstream stream(args ? args : "");
+  std::string arg;
+  while (stream >> arg) {
+    size_t equal = arg.find('=');
+    std::string key = arg.substr(0, equal);
+    std::string value = equal == std::string::npos ? "" : arg.substr(equal + 1);
+    if (key == "mode") {
+      config.mode = value == "trot" ? StandInMode::TROT : StandInMode::STAND;
+    }
+    else if (key == "kp") {
+      config.kp = atof(value.c_str());
+    }
+    else if (key == "kd") {
+      config.kd = atof(value.c_str());
+    }
+    else if (key == "delay-us") {
+      config.compute_delay_ns = atol(value.c_str()) * 1000;
+    }
+    else {
+      printf("[Stand-in] unknown argument %s\n", arg.c_str());
+    }
+  }
+
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+  message->robotToSim.controlParameterTableSupport = kCONTROL_PARAMETER_TABLE_MAGIC;
+#else
+  (void)message;
+#endif
+  return new StandInController(config);
+}
+
+s32 sim_controller_handle_parameter(void *controller, SimulatorMessage *message, ControlParameterTable *table)
+{
+  static_cast<StandInController *>(controller)->HandleControlParameters(*message, table);
+  return 0;
+}
+
+s32 sim_controller_step(void *controller, const SimulatorToRobotMessage *sim_to_robot, RobotToSimulatorMessage *robot_to_sim)
+{
+  static_cast<StandInController *>(controller)->RunController(*sim_to_robot, robot_to_sim->spiCommand);
+  return 0;
+}
+
+void sim_controller_shutdown(void *controller)
+{
+  delete static_cast<StandInController *>(controller);
+}
+
+}
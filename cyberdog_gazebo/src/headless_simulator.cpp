@@ -0,0 +1,341 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "actuator.hpp"
+#include "legged_simparam.hpp"
+#include "rigid_body_dynamics.hpp"
+
+using namespace gazebo;
+
+namespace
+{
+  struct HeadlessConfig
+  {
+    std::string urdf;
+    std::string controller_library;
+    std::string controller_args;
+    double dt = 0.0005;               // physics step, the contacts need 0.5 ms or less
+    int control_decimation = 4;       // physics steps per control tick, 2 ms as in gazebo
+    double duration = 0;              // sim seconds, 0 runs until interrupted
+    double real_time_factor = 0;      // pace to this factor of wall time, 0 runs as fast as possible
+    double height = 0.3;              // initial base height
+    double controller_timeout = 1.0;
+    double safe_hold_kd = 1.0;
+    int instance = SimulatorInstanceFromEnv();
+    SharedMemorySyncMode sync_mode = SharedMemorySyncMode::kSemaphore;
+  };
+
+  /**
+   * @brief The quadruped on the rigid body backend, joined to a control program
+   *        the same way LeggedPlugin is: state out and SpiCommand in through
+   *        SimParam every control_decimation physics steps, torques through
+   *        the PD law and the actuator model in between
+   */
+  class HeadlessSimulator
+  {
+  public:
+    HeadlessSimulator(const HeadlessConfig &config, const RigidBodyModel &model, NodeExc *node_executor)
+    : config_(config), model_(model), dynamics_(model),
+      simparam_("cyberdog", node_executor, config.sync_mode, config.instance)
+    {
+      // start crouched with the stand-in's standing angles, hip and knee at 60%
+      double q[RigidBodyModel::kMaxBodies] = {0};
+      const double crouch[3] = {0.0, -0.45, 0.9};
+      for (int i = 0; i < 12; i++) {
+        q[model_.ControlJointBody(i)] = model_.ControlJointSign(i) * crouch[i % 3];
+      }
+      dynamics_.Reset(SpatialVec3(0, 0, config_.height), Eigen::Quaterniond::Identity(), q);
+      std::fill(tau_, tau_ + RigidBodyModel::kMaxBodies, 0.0);
+      simparam_.SetControllerTimeout(config_.controller_timeout);
+      simparam_.SetErrorCallback([this](std::string reason) {disconnect_reason_ = reason;});
+      if (!config_.controller_library.empty()) {
+        simparam_.LoadControllerLibrary(config_.controller_library, config_.controller_args);
+      }
+    }
+
+    void Run()
+    {
+      simparam_.FirstRun();
+      HoldJoints();
+      SIM_LOG_INFO("[Headless] control program attached, physics step %g s, control period %g s", config_.dt,
+                   config_.dt * config_.control_decimation);
+
+      auto start = std::chrono::steady_clock::now();
+      auto report_wall = start;
+      double report_time = 0;
+      long steps = 0;
+      while (rclcpp::ok() && (config_.duration <= 0 || dynamics_.Time() < config_.duration)) {
+        if (steps % config_.control_decimation == 0) {
+          ControlTick();
+        }
+        ApplyCommand();
+        dynamics_.Step(tau_, config_.dt);
+        steps++;
+
+        if (config_.real_time_factor > 0) {
+          std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(dynamics_.Time() / config_.real_time_factor)));
+        }
+        auto now = std::chrono::steady_clock::now();
+        double wall = std::chrono::duration<double>(now - report_wall).count();
+        if (wall >= 5.0) {
+          SIM_LOG_INFO("[Headless] sim time %.1f s, %.1fx real time, base height %.3f m", dynamics_.Time(),
+                       (dynamics_.Time() - report_time) / wall, dynamics_.BasePosition().z());
+          report_wall = now;
+          report_time = dynamics_.Time();
+        }
+      }
+      double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      SIM_LOG_INFO("[Headless] %.1f sim seconds in %.1f wall seconds, %.1fx real time", dynamics_.Time(), wall,
+                   dynamics_.Time() / std::max(wall, 1e-9));
+    }
+
+  private:
+    /**
+     * @brief Hand the state to the control program and take its command, as
+     *        LeggedPlugin::OnUpdate does at a control tick
+     */
+    void ControlTick()
+    {
+      if (simparam_.StateWritable()) {
+        FillState(simparam_.StateView());
+        simparam_.CommitState();
+        if (simparam_.CollectSMData() == CollectResult::kCollected) {
+          cmd_ = simparam_.CommandView();
+        }
+      }
+      if (connected_ && !simparam_.Connected()) {
+        connected_ = false;
+        HoldJoints();
+        SIM_LOG_WARN("[Headless] control program disconnected (%s), damping the joints with kd %g", disconnect_reason_.c_str(),
+                     config_.safe_hold_kd);
+      }
+      else if (!connected_ && simparam_.PollReconnect()) {
+        connected_ = true;
+        HoldJoints();
+        SIM_LOG_INFO("[Headless] control program reconnected");
+      }
+      simparam_.ReceiveTopic();
+    }
+
+    /**
+     * @brief Write the state in place into the sharedmemory, as LeggedPlugin::SendSMData
+     */
+    void FillState(const SimulatorStateView &state)
+    {
+      Eigen::Quaterniond imu = dynamics_.ImuOrientation();
+      state.vectorNav.quat[0] = imu.x();
+      state.vectorNav.quat[1] = imu.y();
+      state.vectorNav.quat[2] = imu.z();
+      state.vectorNav.quat[3] = imu.w();
+      state.vectorNav.gyro = dynamics_.ImuAngularVelocity().cast<float>();
+      state.vectorNav.accelerometer = dynamics_.ImuLinearAcceleration().cast<float>();
+
+      for (int leg = 0; leg < 4; leg++) {
+        state.spiData.q_abad[leg] = ControlQ(leg * 3 + 0);
+        state.spiData.q_hip[leg] = ControlQ(leg * 3 + 1);
+        state.spiData.q_knee[leg] = ControlQ(leg * 3 + 2);
+        state.spiData.qd_abad[leg] = ControlQd(leg * 3 + 0);
+        state.spiData.qd_hip[leg] = ControlQd(leg * 3 + 1);
+        state.spiData.qd_knee[leg] = ControlQd(leg * 3 + 2);
+        state.spiData.tau_abad[leg] = ControlTau(leg * 3 + 0);
+        state.spiData.tau_hip[leg] = ControlTau(leg * 3 + 1);
+        state.spiData.tau_knee[leg] = ControlTau(leg * 3 + 2);
+      }
+
+      Eigen::Quaterniond base = dynamics_.BaseOrientation();
+      state.cheaterState.position = dynamics_.BasePosition();
+      state.cheaterState.orientation[0] = base.w();
+      state.cheaterState.orientation[1] = base.x();
+      state.cheaterState.orientation[2] = base.y();
+      state.cheaterState.orientation[3] = base.z();
+      state.cheaterState.vBody = dynamics_.BaseLinearVelocity();
+      state.cheaterState.omegaBody = dynamics_.BaseAngularVelocity();
+    }
+
+    /**
+     * @brief Joint torques of the current command, the spine boards and motor model of LeggedPlugin::SetJointCom
+     */
+    void ApplyCommand()
+    {
+      for (int leg = 0; leg < 4; leg++) {
+        spi_data_.q_abad[leg] = ControlQ(leg * 3);
+        spi_data_.q_hip[leg] = ControlQ(leg * 3 + 1);
+        spi_data_.q_knee[leg] = ControlQ(leg * 3 + 2);
+        spi_data_.qd_abad[leg] = ControlQd(leg * 3);
+        spi_data_.qd_hip[leg] = ControlQd(leg * 3 + 1);
+        spi_data_.qd_knee[leg] = ControlQd(leg * 3 + 2);
+      }
+      spine_board_.cmd = &cmd_;
+      spine_board_.data = &spi_data_;
+      spine_board_.run();
+
+      ActuatorBatch::Array12d effort;
+      ActuatorBatch::Array12d qd;
+      for (int i = 0; i < 12; i++) {
+        effort[i] = model_.ControlJointSign(i) * spine_board_.torque_out[i % 3][i / 3];
+        qd[i] = dynamics_.Qd(model_.ControlJointBody(i));
+      }
+      motor_.GetTorque(effort, qd);
+      motor_.CurrentLoopResponse(effort);
+      for (int i = 0; i < 12; i++) {
+        tau_[model_.ControlJointBody(i)] = effort[i];
+      }
+    }
+
+    /**
+     * @brief Damp the joints where they are until a control program answers
+     */
+    void HoldJoints()
+    {
+      SpiCommand hold;
+      for (int leg = 0; leg < 4; leg++) {
+        hold.q_des_abad[leg] = ControlQ(leg * 3);
+        hold.q_des_hip[leg] = ControlQ(leg * 3 + 1);
+        hold.q_des_knee[leg] = ControlQ(leg * 3 + 2);
+        hold.kd_abad[leg] = config_.safe_hold_kd;
+        hold.kd_hip[leg] = config_.safe_hold_kd;
+        hold.kd_knee[leg] = config_.safe_hold_kd;
+        hold.flags[leg] = 1;
+      }
+      cmd_ = hold;
+    }
+
+    double ControlQ(int i) const {return model_.ControlJointSign(i) * dynamics_.Q(model_.ControlJointBody(i));}
+    double ControlQd(int i) const {return model_.ControlJointSign(i) * dynamics_.Qd(model_.ControlJointBody(i));}
+    double ControlTau(int i) const {return model_.ControlJointSign(i) * dynamics_.Tau(model_.ControlJointBody(i));}
+
+    const HeadlessConfig &config_;
+    const RigidBodyModel &model_;
+    RigidBodyDynamics dynamics_;
+    SimParam simparam_;
+    ActuatorBatch motor_;
+    SpiCommand cmd_;
+    SpineBoard spine_board_;
+    SpiData spi_data_;
+    double tau_[RigidBodyModel::kMaxBodies];
+    bool connected_ = true;
+    std::string disconnect_reason_;
+  };
+
+  void Usage(const char *program)
+  {
+    printf("Usage: %s --urdf FILE [options]\n"
+           "  --urdf FILE               robot description, e.g. xacro cyberdog_description/xacro/robot.xacro > cyberdog.urdf\n"
+           "  --dt S                    physics step (default 0.0005)\n"
+           "  --decimation N            physics steps per control tick (default 4)\n"
+           "  --duration S              stop after S sim seconds (default run until interrupted)\n"
+           "  --real-time-factor F      pace the simulation to F times real time (default as fast as possible)\n"
+           "  --height M                initial base height (default 0.3)\n"
+           "  --instance N              simulator instance (default CYBERDOG_SIM_INSTANCE or 0)\n"
+           "  --sync MODE               semaphore or seqlock (default semaphore)\n"
+           "  --controller-timeout S    disconnect a control program slower than S, 0 waits forever (default 1)\n"
+           "  --controller-library FILE run the control program in process, see controller_library_interface.hpp\n"
+           "  --controller-args ARGS    passed to the controller library\n"
+           "  --log-level LEVEL         debug, info, warn or error (default info)\n",
+           program);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  HeadlessConfig config;
+
+  // ros arguments are left to rclcpp, the rest are ours
+  rclcpp::init(argc, argv);
+  std::vector<std::string> arguments = rclcpp::remove_ros_arguments(argc, argv);
+  std::vector<char *> args;
+  for (std::string &argument : arguments) {
+    args.push_back(&argument[0]);
+  }
+  args.push_back(nullptr);
+
+  const struct option options[] = {
+    {"urdf", required_argument, nullptr, 'u'},
+    {"dt", required_argument, nullptr, 't'},
+    {"decimation", required_argument, nullptr, 'n'},
+    {"duration", required_argument, nullptr, 'T'},
+    {"real-time-factor", required_argument, nullptr, 'r'},
+    {"height", required_argument, nullptr, 'z'},
+    {"instance", required_argument, nullptr, 'i'},
+    {"sync", required_argument, nullptr, 's'},
+    {"controller-timeout", required_argument, nullptr, 'w'},
+    {"controller-library", required_argument, nullptr, 'l'},
+    {"controller-args", required_argument, nullptr, 'a'},
+    {"log-level", required_argument, nullptr, 'L'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}};
+
+  int opt;
+  while ((opt = getopt_long(int(arguments.size()), args.data(), "h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 'u': config.urdf = optarg; break;
+      case 't': config.dt = atof(optarg); break;
+      case 'n': config.control_decimation = std::max(1, atoi(optarg)); break;
+      case 'T': config.duration = atof(optarg); break;
+      case 'r': config.real_time_factor = atof(optarg); break;
+      case 'z': config.height = atof(optarg); break;
+      case 'i': config.instance = atoi(optarg); break;
+      case 's': config.sync_mode = std::string(optarg) == "seqlock" ? SharedMemorySyncMode::kSeqlock : SharedMemorySyncMode::kSemaphore; break;
+      case 'w': config.controller_timeout = atof(optarg); break;
+      case 'l': config.controller_library = optarg; break;
+      case 'a': config.controller_args = optarg; break;
+      case 'L': {
+        LogLevel level;
+        if (!ParseLogLevel(optarg, level)) {
+          printf("[Headless] %s is not debug, info, warn or error\n", optarg);
+          rclcpp::shutdown();
+          return 1;
+        }
+        AsyncLogger::Instance().SetLevel(level);
+        break;
+      }
+      default:
+        Usage(argv[0]);
+        rclcpp::shutdown();
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (config.urdf.empty() || config.dt <= 0) {
+    Usage(argv[0]);
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  RigidBodyModel model;
+  std::string error;
+  if (!model.Load(config.urdf, error)) {
+    printf("[Headless] %s: %s\n", config.urdf.c_str(), error.c_str());
+    rclcpp::shutdown();
+    return 1;
+  }
+  SIM_LOG_INFO("[Headless] %s: %d bodies, %zu contact points, %.3f kg", config.urdf.c_str(), model.NumBodies(),
+               model.Contacts().size(), model.TotalMass());
+
+  {
+    NodeExc node_executor(config.instance > 0 ? "sim" + std::to_string(config.instance) : "");
+    HeadlessSimulator simulator(config, model, &node_executor);
+    simulator.Run();
+  }
+  rclcpp::shutdown();
+  AsyncLogger::Instance().Flush();
+  return 0;
+}
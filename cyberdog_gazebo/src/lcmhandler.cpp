@@ -11,72 +11,172 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include "lcmhandler.hpp"
+#include "async_logger.hpp"
 
 namespace gazebo
 {
-    LCMHandler::LCMHandler(){
+    /**
+     * @brief Lcm url of a simulator instance, every instance gets its own multicast port
+     * 
+     * @param instance simulator instance
+     * @return std::string empty for instance 0 so LCM_DEFAULT_URL is still honored
+     */
+    static std::string LCMUrl(int instance)
+    {
+        if (instance <= 0) {
+            return "";
+        }
+        return "udpm://239.255.76.67:" + std::to_string(7667 + instance) + "?ttl=0";
+    }
+
+    LCMHandler::LCMHandler(int instance, int state_decimation)
+    :lcm_(LCMUrl(instance)), state_decimation_(state_decimation){
         if (!lcm_.good()){
          exit(1);
        }
 
     lcm_.subscribe("gamepad_lcmt", &LCMHandler::HandleCommand, this);
 
+        // Gamepad messages are decoded off the physics thread
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_CLOEXEC);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = lcm_.getFileno();
+        bool reactor_ready = epoll_fd_ != -1 && stop_fd_ != -1 &&
+                             epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event.data.fd, &event) == 0;
+        event.data.fd = stop_fd_;
+        reactor_ready = reactor_ready && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event) == 0;
+        if (reactor_ready) {
+            reactor_ = std::thread(&LCMHandler::ReactorLoop, this);
+        }
+        else {
+            SIM_LOG_ERROR("[Simulation] gamepad lcm reactor not started, gamepad commands are ignored: %s", strerror(errno));
+        }
+
+        // Encoding and the udp send run on their own thread
+        if (state_decimation_ > 0) {
+            sem_init(&state_ready_, 0, 0);
+            publishing_ = true;
+            publisher_ = std::thread(&LCMHandler::PublishLoop, this);
+        }
+        else {
+            SIM_LOG_INFO("[Simulation] simulator_state lcm channel disabled");
+        }
     }
 
-    GamepadCommand LCMHandler::ReceiveGPC()
+    LCMHandler::~LCMHandler()
     {
-        lcm_.handle();
-        gamepad_command_.a=lcm_gamepad_.a;
-        gamepad_command_.b=lcm_gamepad_.b;
-        gamepad_command_.x=lcm_gamepad_.x;
-        gamepad_command_.y=lcm_gamepad_.y;
-        gamepad_command_.leftStickAnalog[0]=lcm_gamepad_.leftStickAnalog[0];
-        gamepad_command_.leftStickAnalog[1]=lcm_gamepad_.leftStickAnalog[1];
-        gamepad_command_.rightStickAnalog[0]=lcm_gamepad_.rightStickAnalog[0];
-        gamepad_command_.rightStickAnalog[1]=lcm_gamepad_.rightStickAnalog[1];
+        if (reactor_.joinable()) {
+            uint64_t stop = 1;
+            while (write(stop_fd_, &stop, sizeof(stop)) == -1 && errno == EINTR) {
+            }
+            reactor_.join();
+        }
+        if (stop_fd_ != -1) {
+            close(stop_fd_);
+        }
+        if (epoll_fd_ != -1) {
+            close(epoll_fd_);
+        }
 
-        return gamepad_command_;
+        if (publishing_) {
+            publishing_ = false;
+            sem_post(&state_ready_);
+            publisher_.join();
+            sem_destroy(&state_ready_);
+            if (Dropped() > 0) {
+                SIM_LOG_WARN("[Simulation] simulator_state lcm dropped %ld messages", Dropped());
+            }
+            else {
+                SIM_LOG_INFO("[Simulation] simulator_state lcm dropped no messages");
+            }
+        }
+    }
+
+    bool LCMHandler::ReceiveGPC(GamepadCommand &command)
+    {
+        return gamepad_mailbox_.Take(command);
     }
 
     void LCMHandler::HandleCommand(const lcm::ReceiveBuffer *rbuf, const std::string &chan, const gamepad_lcmt *msg)
     {
-        lcm_gamepad_ = *msg;
+        GamepadCommand command;
+        command.a=msg->a;
+        command.b=msg->b;
+        command.x=msg->x;
+        command.y=msg->y;
+        command.leftStickAnalog[0]=msg->leftStickAnalog[0];
+        command.leftStickAnalog[1]=msg->leftStickAnalog[1];
+        command.rightStickAnalog[0]=msg->rightStickAnalog[0];
+        command.rightStickAnalog[1]=msg->rightStickAnalog[1];
+        gamepad_mailbox_.Put(command);
     }
 
-    bool LCMHandler::HasEvent()
+    void LCMHandler::ReactorLoop()
     {
-        // setup the LCM file descriptor for waiting.
         int lcm_fd = lcm_.getFileno();
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(lcm_fd, &fds);
-
-        // wait a limited amount of time for an incoming message
-        struct timeval timeout = {
-            0, // seconds
-            1  // microseconds
-        };
-        int status = select(lcm_fd + 1, &fds, 0, 0, &timeout);
+        struct epoll_event events[2];
+        while (true) {
+            int n = epoll_wait(epoll_fd_, events, 2, -1);
+            for (int i = 0; i < n; i++) {
+                if (events[i].data.fd == stop_fd_) {
+                    return;
+                }
+                if (events[i].data.fd == lcm_fd) {
+                    lcm_.handle();
+                }
+            }
+        }
+    }
 
-        if (0 == status) {
-        // no messages
-        return false;
+    void LCMHandler::SendSimData(simulator_lcmt &_lcm_sim_handler)
+    {
+        if (state_decimation_ <= 0 || state_count_++ % state_decimation_ != 0) {
+            return;
         }
-        else if (FD_ISSET(lcm_fd, &fds)) {
-        // LCM has events ready to be processed.
-        return true;
+        if (state_queue_.TryPush(_lcm_sim_handler)) {
+            // Pairs with the fence in PublishLoop, one of the two sees the other's store
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (publisher_waiting_.load(std::memory_order_relaxed) && publisher_waiting_.exchange(false)) {
+                sem_post(&state_ready_);
+            }
         }
-        else{
-        // Undefined
-        return false;
+        else {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
         }
     }
 
-    void LCMHandler::SendSimData(simulator_lcmt &_lcm_sim_handler)
+    void LCMHandler::PublishLoop()
     {
-        lcm_.publish("simulator_state", &_lcm_sim_handler);
+        simulator_lcmt state;
+        encode_buffer_.resize(state.getEncodedSize());
+        while (true) {
+            if (!state_queue_.TryPop(state)) {
+                if (!publishing_) {
+                    return;
+                }
+                // Announce the wait before the last look, so a push in between posts
+                publisher_waiting_.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!state_queue_.TryPop(state)) {
+                    sem_wait(&state_ready_);
+                    continue;
+                }
+                publisher_waiting_.store(false);
+            }
+            int size = state.encode(encode_buffer_.data(), 0, encode_buffer_.size());
+            if (size > 0) {
+                lcm_.publish("simulator_state", encode_buffer_.data(), size);
+            }
+        }
     }
 
 }
\ No newline at end of file
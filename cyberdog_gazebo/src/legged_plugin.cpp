@@ -20,16 +20,44 @@ namespace gazebo
   // Register this plugin with the simulator
   GZ_REGISTER_MODEL_PLUGIN(LeggedPlugin)
 
-  _contact_force GetContactForce(const msgs::Contacts &contacts)
+  LeggedPlugin::~LeggedPlugin()
+  {
+    update_connection_.reset();
+
+    // The executor and the lcm threads call back into this plugin, their
+    // destructors join them before anything they use goes away
+    delete node_executor_;
+    node_executor_ = nullptr;
+    delete lcmhandler_;
+    lcmhandler_ = nullptr;
+    delete simparam_;
+    simparam_ = nullptr;
+
+    if (!profiler_.Enabled()) {
+      return;
+    }
+    profiler_.Roll();
+    SIM_LOG_INFO("[Simulation] tick profile in us: phase count mean p50 p99 p99.9 max");
+    for (int i = 0; i < kNumTickPhases; i++) {
+      const TickHistogram &histogram = profiler_.Total(TickPhase(i));
+      SIM_LOG_INFO("[Simulation]   %-18s %10lu %9.2f %9.2f %9.2f %9.2f %9.2f", kTickPhaseNames[i], (unsigned long)histogram.Count(),
+             histogram.Mean() * 1e-3, histogram.Quantile(0.5) * 1e-3, histogram.Quantile(0.99) * 1e-3,
+             histogram.Quantile(0.999) * 1e-3, histogram.Max() * 1e-3);
+    }
+    if (!profile_file_.empty() && !profiler_.Dump(profile_file_)) {
+      SIM_LOG_ERROR("[Simulation] could not write tick profile to %s", profile_file_.c_str());
+    }
+  }
+
+  _contact_force GetContactForce(const msgs::Contacts &contacts, const physics::LinkPtr &foot_link)
   { 
     Eigen::Vector3d force;
-    std::string parent_name;
     unsigned int count_ = contacts.contact_size();
     for (unsigned int i = 0; i < count_; ++i) {
 
       if (contacts.contact(i).position_size() != 1) {
 
-        std::cerr << "Contact count isn't correct!!!!" << std::endl;
+        SIM_LOG_WARN("Contact count isn't correct!!!!");
       }
 
       for (int j = 0; j < contacts.contact(i).position_size(); ++j) {
@@ -45,42 +73,76 @@ namespace gazebo
       force[0] = force[0] / double(count_);
       force[1] = force[1] / double(count_);
       force[2] = force[2] / double(count_);
-
-      
-      
-      parent_name = contacts.contact(0).wrench(0).body_1_name();
-      int index = parent_name.find("::");
-      parent_name = parent_name.substr(index+2,parent_name.length());
-      index = parent_name.find("::");
-      parent_name = parent_name.substr(0,index);  
     }
     else {
       force[0] = 0;
       force[1] = 0;
       force[2] = 0;
-      parent_name = "";
     }
      
-    return {force, parent_name};
+    return {force, count_ != 0 ? foot_link : nullptr};
   }
 
   void LeggedPlugin::Load(physics::ModelPtr _parent, sdf::ElementPtr _sdf)
   {
-    std::cout << "**************Enter plugin**************" << std::endl;
+    // Messages below logLevel are dropped before they are formatted
+    LogLevel log_level = LogLevel::kInfo;
+    if (_sdf->HasElement("logLevel") && !ParseLogLevel(_sdf->Get<std::string>("logLevel"), log_level)) {
+      SIM_LOG_ERROR("[Simulation] logLevel: %s is not debug, info, warn or error", _sdf->Get<std::string>("logLevel").c_str());
+    }
+    AsyncLogger::Instance().SetLevel(log_level);
+
+    SIM_LOG_INFO("**************Enter plugin**************");
     // Store the pointer to the model
     model_ = _parent;
     
-    std::cout<<model_->GetName()<<" is import"<<std::endl;
+    SIM_LOG_INFO("%s is import", model_->GetName().c_str());
+
+    // Simulator instance scopes sharedmemory, semaphores, lcm and ros names so
+    // several simulators can run on one host, taken from sdf or environment
+    int instance = SimulatorInstanceFromEnv();
+    if (_sdf->HasElement("instanceId")) {
+      instance = _sdf->Get<int>("instanceId");
+    }
+    std::string ros_namespace = instance > 0 ? "sim" + std::to_string(instance) : "";
+    if (_sdf->HasElement("rosNamespace")) {
+      ros_namespace = _sdf->Get<std::string>("rosNamespace");
+    }
+    SIM_LOG_INFO("Simulator instance %d, ros namespace \"%s\"", instance, ros_namespace.c_str());
 
     // Initialize node executor the recieve topic messages 
-    node_executor_ = new NodeExc();
+    node_executor_ = new NodeExc(ros_namespace);
 
-    force_node_ = std::make_shared<GazeboNode>("force_node");
+    force_node_ = node_executor_->CreateNode("force_node");
     for_sub_ = force_node_->create_subscription<cyberdog_msg::msg::ApplyForce>("apply_force", 10, std::bind(&LeggedPlugin::ForceHandler,this,std::placeholders::_1));
     node_executor_->AddNode(force_node_);
 
+    // Select the synchronization of sharedmemory, "semaphore" (default) or "seqlock"
+    SharedMemorySyncMode sync_mode = SharedMemorySyncMode::kSemaphore;
+    if (_sdf->HasElement("syncMode") && _sdf->Get<std::string>("syncMode") == "seqlock") {
+      sync_mode = SharedMemorySyncMode::kSeqlock;
+    }
+
+    // Sharedmemory backing: prefault, lock and "none", "thp" or "hugetlbfs" huge pages
+    SharedMemoryOptions shm_options;
+    if (_sdf->HasElement("shmPopulate")) {
+      shm_options.populate = _sdf->Get<bool>("shmPopulate");
+    }
+    if (_sdf->HasElement("shmLock")) {
+      shm_options.lock = _sdf->Get<bool>("shmLock");
+    }
+    if (_sdf->HasElement("shmHugepages")) {
+      std::string hugepages = _sdf->Get<std::string>("shmHugepages");
+      if (hugepages == "thp") {
+        shm_options.backing = SharedMemoryBacking::kTransparentHugePages;
+      }
+      else if (hugepages == "hugetlbfs") {
+        shm_options.backing = SharedMemoryBacking::kHugetlbfs;
+      }
+    }
+
     // Initialize the sender and recieve of simulator parameters
-    simparam_ = new SimParam(model_->GetName(),node_executor_);
+    simparam_ = new SimParam(model_->GetName(),node_executor_,sync_mode,instance,shm_options);
 
     // Listen to the update event. This event is broadcast every
     // simulation iteration.
@@ -95,71 +157,65 @@ namespace gazebo
       if (sensors_[i]->ScopedName().find("::" + model_->GetName() + "::") != std::string::npos)
       {
         sensors_attached_to_robot_.push_back(sensors_[i]);
-        std::cout << sensors_attached_to_robot_[i]->ScopedName() << std::endl;
+        SIM_LOG_INFO("%s", sensors_attached_to_robot_[i]->ScopedName().c_str());
       }
     }
 
     for (unsigned int i = 0; i < sensors_attached_to_robot_.size(); ++i) {
       if (sensors_attached_to_robot_[i]->Type().compare("imu") == 0) {
         imu_sensor_ = std::static_pointer_cast<gazebo::sensors::ImuSensor>(sensors_attached_to_robot_[i]);
-        std::cout << "IMU found: " << imu_sensor_->Name() << std::endl;
+        SIM_LOG_INFO("IMU found: %s", imu_sensor_->Name().c_str());
       }
       if (sensors_attached_to_robot_[i]->Name().compare("FL_foot_contact") == 0) {
         contact_sensor_fl_ = std::static_pointer_cast<gazebo::sensors::ContactSensor>(sensors_attached_to_robot_[i]);
-        std::cout << "Contact sensor found: " << contact_sensor_fl_->Name() << std::endl;
+        SIM_LOG_INFO("Contact sensor found: %s", contact_sensor_fl_->Name().c_str());
       }
       if (sensors_attached_to_robot_[i]->Name().compare("FR_foot_contact") == 0) {
         contact_sensor_fr_ = std::static_pointer_cast<gazebo::sensors::ContactSensor>(sensors_attached_to_robot_[i]);
-        std::cout << "Contact sensor found: " << contact_sensor_fr_->Name() << std::endl;
+        SIM_LOG_INFO("Contact sensor found: %s", contact_sensor_fr_->Name().c_str());
       }
       if (sensors_attached_to_robot_[i]->Name().compare("RL_foot_contact") == 0) {
         contact_sensor_hl_ = std::static_pointer_cast<gazebo::sensors::ContactSensor>(sensors_attached_to_robot_[i]);
-        std::cout << "Contact sensor found: " << contact_sensor_hl_->Name() << std::endl;
+        SIM_LOG_INFO("Contact sensor found: %s", contact_sensor_hl_->Name().c_str());
       }
       if (sensors_attached_to_robot_[i]->Name().compare("RR_foot_contact") == 0) {
         contact_sensor_hr_ = std::static_pointer_cast<gazebo::sensors::ContactSensor>(sensors_attached_to_robot_[i]);
-        std::cout << "Contact sensor found: " << contact_sensor_hr_->Name() << std::endl;
+        SIM_LOG_INFO("Contact sensor found: %s", contact_sensor_hr_->Name().c_str());
 
       }
-      contact_ = std::vector<double>(4, 1.0);
     }
 
-    // iterate over Gazebo model Joint vector and store Joint pointers in a map
+    // Foot contact forces are expressed in the link the sensor is attached to
+    gazebo::sensors::ContactSensorPtr contact_sensors[4] = {contact_sensor_fl_, contact_sensor_fr_, contact_sensor_hl_, contact_sensor_hr_};
+    for (int i = 0; i < 4; i++) {
+      if (contact_sensors[i]) {
+        foot_links_[i] = model_->GetLink(contact_sensors[i]->ParentName());
+      }
+    }
+
+    // Resolve the gazebo joints once, permuted to control program order. Control
+    // program leg i is gazebo leg kleg_map[i], hip and knee turn the other way
     const gazebo::physics::Joint_V &joints = model_->GetJoints();
     for (unsigned int i = 0; i < joints.size(); i++) {
-      std::string joint_name = joints[i]->GetName();
-      joint_names_.push_back(joint_name);
-      joint_map_[joint_name] = model_->GetJoint(joint_name);
-      std::cout << "Joint # " << i << " - " << joint_name << std::endl;
-    }
-
-    q_.resize(joints.size());
-    dq_.resize(joints.size());
-    tau_.resize(joints.size());
-    q_ctrl_.resize(joints.size());
-    dq_ctrl_.resize(joints.size());
-    tau_ctrl_.resize(joints.size());
-    for (unsigned int i = 0; i < joint_names_.size(); i++){
-      unsigned int index = 0;
-      std::string n = joint_names_[i];
-      q_[i] = joint_map_[n]->Position(index);
-      dq_[i] = joint_map_[n]->GetVelocity(index);
-      tau_[i] = joint_map_[n]->GetForce(index);
+      SIM_LOG_INFO("Joint # %u - %s", i, joints[i]->GetName().c_str());
     }
-
-        for (uint i = 0; i < 4; i++)
-    {
-      q_ctrl_[3*i] = q_[3*i];
-      q_ctrl_[3*i+1] = -q_[3*i+1];
-      q_ctrl_[3*i+2] = -q_[3*i+2];
-      dq_ctrl_[3*i] = dq_[3*i];
-      dq_ctrl_[3*i+1] = -dq_[3*i+1];
-      dq_ctrl_[3*i+2] = -dq_[3*i+2];
-      tau_ctrl_[3*i] = tau_[3*i];
-      tau_ctrl_[3*i+1] = -tau_[3*i+1];
-      tau_ctrl_[3*i+2] = -tau_[3*i+2];
+    base_link_ = model_->GetLink("base_link");
+    if (joints.size() < 12 || !base_link_) {
+      SIM_LOG_ERROR("[Simulation] %s has %zu joints and %s base_link, 12 joints and a base_link are required",
+                    model_->GetName().c_str(), joints.size(), base_link_ ? "a" : "no");
+      // Nothing to drive, stay out of the world update
+      update_connection_.reset();
+      return;
+    }
+    for (uint leg = 0; leg < 4; leg++) {
+      for (uint j = 0; j < 3; j++) {
+        joints_[leg * 3 + j] = joints[kleg_map[leg] * 3 + j];
+        joint_sign_[leg * 3 + j] = j == 0 ? 1.0 : -1.0;
+      }
     }
 
+    GetJointStates();
+
     // Enable currentloop response limit of the motors
     use_currentloop_response_ = true;
     // Enable TN curve limit of the motors
@@ -167,164 +223,291 @@ namespace gazebo
     // Disable force contact sensors of the robot
     use_force_contact_sensor_ = true;
 
+    // Maximum torque of abad, hip and knee motors, the same for all by default
+    if (_sdf->HasElement("actuatorTauMax")) {
+      ignition::math::Vector3d tau_max = _sdf->Get<ignition::math::Vector3d>("actuatorTauMax");
+      for (int i = 0; i < 12; i++) {
+        ActuatorParameters parameters;
+        parameters.tau_max = tau_max[i % 3];
+        motor_.SetParameters(i, parameters);
+      }
+    }
+
+    // Read foot contacts from the physics engine every step ("physics", default)
+    // or from the contact sensors at their update rate ("sensor")
+    use_physics_contact_ = !_sdf->HasElement("contactSource") || _sdf->Get<std::string>("contactSource") != "sensor";
+    if (use_physics_contact_ && !InitPhysicsContacts()) {
+      SIM_LOG_WARN("[Simulation] foot collisions not found, falling back to contact sensors");
+      use_physics_contact_ = false;
+    }
+
+    // Real time scheduling: SCHED_FIFO and cpus for the update thread, memory
+    // locking for the process and a recommendation for the control program
+    if (_sdf->HasElement("rtPriority")) {
+      rt_priority_ = std::max(0, _sdf->Get<int>("rtPriority"));
+    }
+    if (_sdf->HasElement("cpuAffinity") && !ParseCpuList(_sdf->Get<std::string>("cpuAffinity"), sim_cpus_)) {
+      SIM_LOG_ERROR("[Simulation] cpuAffinity: bad cpu list %s", _sdf->Get<std::string>("cpuAffinity").c_str());
+      sim_cpus_ = 0;
+    }
+    if (_sdf->HasElement("lockMemory") && _sdf->Get<bool>("lockMemory")) {
+      int error = LockProcessMemory();
+      SIM_LOG_INFO("[Simulation] lock memory: %s", error ? strerror(error) : "ok");
+    }
+    uint64_t controller_cpus = 0;
+    if (_sdf->HasElement("controllerAffinity") && !ParseCpuList(_sdf->Get<std::string>("controllerAffinity"), controller_cpus)) {
+      SIM_LOG_ERROR("[Simulation] controllerAffinity: bad cpu list %s", _sdf->Get<std::string>("controllerAffinity").c_str());
+      controller_cpus = 0;
+    }
+    int controller_priority = 0;
+    if (_sdf->HasElement("controllerPriority")) {
+      controller_priority = std::max(0, _sdf->Get<int>("controllerPriority"));
+    }
+    simparam_->RecommendControllerRealTime(controller_priority, controller_cpus);
+
+    // Watchdog: a control program slower than controllerTimeout seconds is
+    // disconnected, the joints are damped until one attaches again
+    if (_sdf->HasElement("controllerTimeout")) {
+      simparam_->SetControllerTimeout(_sdf->Get<double>("controllerTimeout"));
+    }
+    if (_sdf->HasElement("safeHoldDamping")) {
+      safe_hold_kd_ = std::max(0.0, _sdf->Get<double>("safeHoldDamping"));
+    }
+    simparam_->SetErrorCallback([this](std::string reason) {disconnect_reason_ = reason;});
+    connection_node_ = node_executor_->CreateNode("connection_node");
+    connection_pub_ = connection_node_->create_publisher<cyberdog_msg::msg::ControllerConnection>("controller_connection", rclcpp::QoS(10).transient_local());
+
+    // A control program built as a shared library is called from OnUpdate
+    // on the same SimulatorMessage, no semaphores and no second process
+    if (_sdf->HasElement("controllerLibrary") && !_sdf->Get<std::string>("controllerLibrary").empty()) {
+      std::string controller_args = _sdf->HasElement("controllerArgs") ? _sdf->Get<std::string>("controllerArgs") : "";
+      simparam_->LoadControllerLibrary(_sdf->Get<std::string>("controllerLibrary"), controller_args);
+    }
+
     simparam_->FirstRun();
+    PublishConnection(cyberdog_msg::msg::ControllerConnection::CONNECTED, "control program attached");
 
-    // Initialize LCMHandler
-    lcmhandler_ = new LCMHandler();
+    // Initialize LCMHandler, simulator states are published from a background
+    // thread every lcmStateDecimation control ticks, 0 disables them
+    int lcm_state_decimation = 1;
+    if (_sdf->HasElement("lcmStateDecimation")) {
+      lcm_state_decimation = std::max(0, _sdf->Get<int>("lcmStateDecimation"));
+    }
+    lcmhandler_ = new LCMHandler(instance, lcm_state_decimation);
 
-    // Matching gazebo update frequency with control program frequency
+    // Matching gazebo update frequency with control program frequency, the
+    // control period is controlDecimation physics steps
+    if (_sdf->HasElement("controlDecimation")) {
+      control_decimation_ = std::max(1, _sdf->Get<int>("controlDecimation"));
+    }
+    if (_sdf->HasElement("commandInterpolation") && _sdf->Get<std::string>("commandInterpolation") == "linear") {
+      command_interpolation_ = CommandInterpolation::LINEAR;
+    }
+    SIM_LOG_INFO("Control period %g s, %d physics steps, %s joint targets", control_decimation_ * model_->GetWorld()->Physics()->GetMaxStepSize(),
+                 control_decimation_, command_interpolation_ == CommandInterpolation::LINEAR ? "linear" : "zero order hold");
+
+    // Controller answers slower than the deadline are counted, one control period by default
+    double controller_deadline = control_decimation_ * model_->GetWorld()->Physics()->GetMaxStepSize();
+    if (_sdf->HasElement("controllerDeadline") && _sdf->Get<double>("controllerDeadline") > 0) {
+      controller_deadline = _sdf->Get<double>("controllerDeadline");
+    }
+    simparam_->SetControllerDeadline(u64(controller_deadline * 1e9));
+
+    // Pipelined controller and transport delay of commands, both add latency
+    if (_sdf->HasElement("controllerPipeline")) {
+      controller_pipeline_ = _sdf->Get<bool>("controllerPipeline");
+    }
+    if (_sdf->HasElement("commandDelay")) {
+      command_delay_ = std::max(0, _sdf->Get<int>("commandDelay"));
+    }
+
+    // Lockstep drops real time throttling, physics steps as soon as the
+    // controller answers, always in the serial order of operations
+    if (_sdf->HasElement("lockstep")) {
+      lockstep_ = _sdf->Get<bool>("lockstep");
+    }
+    if (lockstep_) {
+      if (controller_pipeline_) {
+        SIM_LOG_INFO("Lockstep runs the controller serially, controllerPipeline ignored");
+        controller_pipeline_ = false;
+      }
+      model_->GetWorld()->Physics()->SetRealTimeUpdateRate(0.0);
+      SIM_LOG_INFO("Lockstep, no real time update rate");
+    }
+
+    cmd_queue_.resize(command_delay_ / control_decimation_ + 2);
+    SIM_LOG_INFO("Command latency %d physics steps%s", (controller_pipeline_ ? control_decimation_ : 0) + command_delay_,
+                 controller_pipeline_ ? ", pipelined controller" : "");
+    cmd_ = simparam_->ReceiveSMData();
+    cmd_prev_ = cmd_;
     frequency_counter_=0; 
 
     // count leg for transfering contact forces to body coordnate
     foot_counter_ = 0;
 
+    // Step N physics steps while paused, e.g.
+    // ros2 service call /step_simulation cyberdog_msg/srv/StepSimulation "{steps: 500}"
+    step_node_ = node_executor_->CreateNode("step_node");
+    step_srv_ = step_node_->create_service<cyberdog_msg::srv::StepSimulation>("step_simulation", std::bind(&LeggedPlugin::StepHandler,this,std::placeholders::_1,std::placeholders::_2));
+    node_executor_->AddNode(step_node_);
+
+    // Per-phase timing of OnUpdate, needs a build with LEGGED_PLUGIN_PROFILER
+    if (_sdf->HasElement("profile") && _sdf->Get<bool>("profile")) {
+      profiler_.Enable(true);
+      if (!profiler_.Enabled()) {
+        SIM_LOG_WARN("[Simulation] profile requested, but legged_plugin was built without LEGGED_PLUGIN_PROFILER");
+      }
+    }
+    if (profiler_.Enabled()) {
+      if (_sdf->HasElement("profileFile")) {
+        profile_file_ = _sdf->Get<std::string>("profileFile");
+      }
+      profile_node_ = node_executor_->CreateNode("profile_node");
+      profile_pub_ = profile_node_->create_publisher<cyberdog_msg::msg::TickProfile>("tick_profile", 10);
+    }
+
   } // LeggedPlugin::Load
 
   // Called by the world update start event
   void LeggedPlugin::OnUpdate()
   {
     // Matching gazebo update frequency with control program frequency
+    profiler_.Start();
+    if(!realtime_applied_) {
+      ApplyRealTime();
+    }
     frequency_counter_++;
+    step_count_++;
 
     GetJointStates();
+    profiler_.Mark(kGetJointStates);
+
+    if(use_physics_contact_) {
+      AccumulatePhysicsContacts();
+      profiler_.Mark(kGetContactForce);
+    }
+
+    // Forces act for one physics step, apply them on every step
+    ApplyForce();
+    profiler_.Mark(kApplyForce);
 
-    if(frequency_counter_<2)
+    if(frequency_counter_<control_decimation_)
     {
       SetJointCom();
+      profiler_.Mark(kSetJointCom);
+      profiler_.End();
       return;
     }
+
+    // Pipelined, wait for the command computed from the previous state
+    // before handing the controller the current one
+    if(controller_pipeline_ && simparam_->Connected()) {
+      if(simparam_->CollectSMData() == CollectResult::kCollected) {
+        ReceiveCommand();
+      }
+      profiler_.Mark(kControllerWait);
+    }
     
+    // Body states feed the telemetry and the body frame forces, connected or not
+    GetBodyStates();
+
     // Send data of robot state by sharedmemory to contorl program 
-    SendSMData();
+    if(simparam_->Connected()) {
+      SendSMData();
+    }
+    profiler_.Mark(kSendSMData);
+
+    if(!controller_pipeline_ && simparam_->Connected()) {
+      if(simparam_->CollectSMData() == CollectResult::kCollected) {
+        ReceiveCommand();
+      }
+      profiler_.Mark(kControllerWait);
+    }
+
+    // The control program timed out or is still away
+    if(!controller_connected_ || !simparam_->Connected()) {
+      WatchController();
+    }
 
     // Received and set joint command of robot from control program 
     SetJointCom();
+    profiler_.Mark(kSetJointCom);
 
-    // Get contact force from foot contact sensor
+    // Get contact force from physics or foot contact sensor
     if(use_force_contact_sensor_) {
-      GetContactForce4();
+      if(use_physics_contact_) {
+        GetPhysicsContactForce4();
+      }
+      else {
+        GetContactForce4();
+      }
+      profiler_.Mark(kGetContactForce);
     }
     
     // Send simulator states by lcm
     lcmhandler_->SendSimData(lcm_sim_handler_);
+    profiler_.Mark(kSendSimData);
 
-    // Receive ros topic
-    node_executor_->ReceiveTopic();
+    // Send control parameters received from the yaml_parameter topic
+    simparam_->ReceiveTopic();
+    profiler_.Mark(kReceiveTopic);
 
-    // Apply force to the links of robot if command is received 
-    ApplyForce();
+    if(lockstep_) {
+      ReportStepRate();
+    }
+
+    // Summarize motor limit violations at most once per sim second
+    ReportActuatorLimits();
 
     frequency_counter_=0; 
 
+    // Publish the phase durations once per wall second
+    if(profiler_.Due(1000000000)) {
+      ReportProfile();
+    }
+    profiler_.End();
   }
 
   void LeggedPlugin::GetJointStates(){
-    for (unsigned int i = 0; i < joint_names_.size(); i++)
+    for (unsigned int i = 0; i < 12; i++)
     {
       unsigned int index = 0;
-      std::string n = joint_names_[i];
-      q_[i] = joint_map_[n]->Position(index);
-      dq_[i] = joint_map_[n]->GetVelocity(index);
-      tau_[i] = joint_map_[n]->GetForce(index);
-      
-    }
-
-    for (uint i = 0; i < 4; i++)
-    {
-      q_ctrl_[3*i] = q_[3*i];
-      q_ctrl_[3*i+1] = -q_[3*i+1];
-      q_ctrl_[3*i+2] = -q_[3*i+2];
-      dq_ctrl_[3*i] = dq_[3*i];
-      dq_ctrl_[3*i+1] = -dq_[3*i+1];
-      dq_ctrl_[3*i+2] = -dq_[3*i+2];
-      tau_ctrl_[3*i] = tau_[3*i];
-      tau_ctrl_[3*i+1] = -tau_[3*i+1];
-      tau_ctrl_[3*i+2] = -tau_[3*i+2];
+      physics::Joint *joint = joints_[i].get();
+      dq_[i] = joint->GetVelocity(index);
+      q_ctrl_[i] = joint_sign_[i] * joint->Position(index);
+      dq_ctrl_[i] = joint_sign_[i] * dq_[i];
+      tau_ctrl_[i] = joint_sign_[i] * joint->GetForce(index);
     }
   }
 
-  void LeggedPlugin::SendSMData()
+  void LeggedPlugin::GetBodyStates()
   {
-
-    // Read IMU data
-    simToRobot.vectorNav.quat[3] = imu_sensor_->Orientation().W();
-    simToRobot.vectorNav.quat[0] = imu_sensor_->Orientation().X();
-    simToRobot.vectorNav.quat[1] = imu_sensor_->Orientation().Y();
-    simToRobot.vectorNav.quat[2] = imu_sensor_->Orientation().Z();
-
-    simToRobot.vectorNav.quat.normalize();
-
-    simToRobot.vectorNav.gyro.x() = imu_sensor_->AngularVelocity()[0];
-    simToRobot.vectorNav.gyro.y() = imu_sensor_->AngularVelocity()[1];
-    simToRobot.vectorNav.gyro.z() = imu_sensor_->AngularVelocity()[2];
-
-    simToRobot.vectorNav.accelerometer.x() = imu_sensor_->LinearAcceleration()[0];
-    simToRobot.vectorNav.accelerometer.y() = imu_sensor_->LinearAcceleration()[1];
-    simToRobot.vectorNav.accelerometer.z() = imu_sensor_->LinearAcceleration()[2];
-    
-    /************to  controller by spiDate************/
-    for (uint i = 0; i < 4; i++)
+    for (uint i = 0; i < 12; i++)
     {
-      simToRobot.spiData.q_abad[kleg_map[i]] = q_ctrl_[3 * i + 0];
-      simToRobot.spiData.q_hip[kleg_map[i]] = q_ctrl_[3 * i + 1];
-      simToRobot.spiData.q_knee[kleg_map[i]] = q_ctrl_[3 * i + 2];
-      simToRobot.spiData.qd_abad[kleg_map[i]] = dq_ctrl_[3 * i + 0];
-      simToRobot.spiData.qd_hip[kleg_map[i]] = dq_ctrl_[3 * i + 1];
-      simToRobot.spiData.qd_knee[kleg_map[i]] = dq_ctrl_[3 * i + 2];
-      simToRobot.spiData.tau_abad[kleg_map[i]] = tau_ctrl_[3 * i + 0];
-      simToRobot.spiData.tau_hip[kleg_map[i]] = tau_ctrl_[3 * i + 1];
-      simToRobot.spiData.tau_knee[kleg_map[i]] = tau_ctrl_[3 * i + 2];
+      lcm_sim_handler_.q[i]=q_ctrl_[i];
+      lcm_sim_handler_.qd[i]=dq_ctrl_[i];
+      lcm_sim_handler_.tau[i]=tau_ctrl_[i];
     }
 
-    for (uint i = 0; i < 4; i++)
-    {
-      for (uint j = 0; j<3; j++)
-      {
-        lcm_sim_handler_.q[kleg_map[i]*3+j]=q_ctrl_[i*3+j];
-        lcm_sim_handler_.qd[kleg_map[i]*3+j]=dq_ctrl_[i*3+j];
-        lcm_sim_handler_.tau[kleg_map[i]*3+j]=tau_ctrl_[i*3+j];
-      }
-    }
+    // Stamp the state with sim time
+    lcm_sim_handler_.time = model_->GetWorld()->SimTime().Double();
+    lcm_sim_handler_.timesteps = model_->GetWorld()->Iterations();
 
     // Read body states
-    ignition::math::Pose3d base_pose;
-    ignition::math::Vector3d base_vel;
-    ignition::math::Vector3d base_omega;
-
-    for (auto &it : model_->GetLinks()) {
-      if (it->GetName() == "base_link") {
-        base_pose = it->WorldPose();
-        base_vel = it->WorldLinearVel();
-        base_omega = it->WorldAngularVel();
-      }
-    }
-  
-    simToRobot.cheaterState.position.x() = base_pose.Pos()[0];
-    simToRobot.cheaterState.position.y() = base_pose.Pos()[1];
-    simToRobot.cheaterState.position.z() = base_pose.Pos()[2];
-    simToRobot.cheaterState.orientation[0] = base_pose.Rot().W();
-    simToRobot.cheaterState.orientation[1] = base_pose.Rot().X();
-    simToRobot.cheaterState.orientation[2] = base_pose.Rot().Y();
-    simToRobot.cheaterState.orientation[3] = base_pose.Rot().Z();
-
-    Eigen::Quaterniond q(base_pose.Rot().W(),
-                        base_pose.Rot().X(),
-                        base_pose.Rot().Y(),
-                        base_pose.Rot().Z());
-
-    q_body_.w()=base_pose.Rot().W();
-    q_body_.x()=base_pose.Rot().X(),
-    q_body_.y()=base_pose.Rot().Y(),
-    q_body_.z()=base_pose.Rot().Z(),
-              
-
+    base_pose_ = base_link_->WorldPose();
+    base_vel_ = base_link_->WorldLinearVel();
+    base_omega_ = base_link_->WorldAngularVel();
+
+    q_body_.w()=base_pose_.Rot().W();
+    q_body_.x()=base_pose_.Rot().X();
+    q_body_.y()=base_pose_.Rot().Y();
+    q_body_.z()=base_pose_.Rot().Z();
     q_body_.normalize();
 
-
-    lcm_sim_handler_.quat[0] = base_pose.Rot().W();
-    lcm_sim_handler_.quat[1] = base_pose.Rot().X();
-    lcm_sim_handler_.quat[2] = base_pose.Rot().Y();
-    lcm_sim_handler_.quat[3] = base_pose.Rot().Z();
+    lcm_sim_handler_.quat[0] = base_pose_.Rot().W();
+    lcm_sim_handler_.quat[1] = base_pose_.Rot().X();
+    lcm_sim_handler_.quat[2] = base_pose_.Rot().Y();
+    lcm_sim_handler_.quat[3] = base_pose_.Rot().Z();
 
     
     Eigen::Vector3d eulerAngle=q_body_.matrix().eulerAngles(2,1,0);
@@ -332,64 +515,163 @@ namespace gazebo
     lcm_sim_handler_.rpy[1]=eulerAngle[1];
     lcm_sim_handler_.rpy[2]=eulerAngle[0];    
 
-    simToRobot.cheaterState.vBody.x() = base_vel[0];
-    simToRobot.cheaterState.vBody.y() = base_vel[1];
-    simToRobot.cheaterState.vBody.z() = base_vel[2];
-    simToRobot.cheaterState.omegaBody.x() = base_omega[0];
-    simToRobot.cheaterState.omegaBody.y() = base_omega[1];
-    simToRobot.cheaterState.omegaBody.z() = base_omega[2];
-
-    simToRobot.cheaterState.vBody = q.conjugate() * simToRobot.cheaterState.vBody;
-    simToRobot.cheaterState.omegaBody = q.conjugate() * simToRobot.cheaterState.omegaBody;
+    Eigen::Vector3d v_body = q_body_.conjugate() * Eigen::Vector3d(base_vel_[0], base_vel_[1], base_vel_[2]);
+    Eigen::Vector3d omega_body = q_body_.conjugate() * Eigen::Vector3d(base_omega_[0], base_omega_[1], base_omega_[2]);
 
     for (uint i = 0; i < 3; i++) {
-      lcm_sim_handler_.p[i]= base_pose.Pos()[i];
-      lcm_sim_handler_.v[i]= base_vel[i];
-      lcm_sim_handler_.vb[i] = simToRobot.cheaterState.vBody[i];
-      lcm_sim_handler_.omega[i] = base_omega[i];
-      lcm_sim_handler_.omegab[i] = simToRobot.cheaterState.omegaBody[i];
+      lcm_sim_handler_.p[i]= base_pose_.Pos()[i];
+      lcm_sim_handler_.v[i]= base_vel_[i];
+      lcm_sim_handler_.vb[i] = v_body[i];
+      lcm_sim_handler_.omega[i] = base_omega_[i];
+      lcm_sim_handler_.omegab[i] = omega_body[i];
+
+    }
+  }
 
+  void LeggedPlugin::SendSMData()
+  {
+    // The state is written in place into the sharedmemory, which the control
+    // program may still read while a tick is in flight
+    if(!simparam_->StateWritable()) {
+      return;
     }
+    SimulatorStateView state = simparam_->StateView();
+
+    // Read IMU data
+    state.vectorNav.quat[3] = imu_sensor_->Orientation().W();
+    state.vectorNav.quat[0] = imu_sensor_->Orientation().X();
+    state.vectorNav.quat[1] = imu_sensor_->Orientation().Y();
+    state.vectorNav.quat[2] = imu_sensor_->Orientation().Z();
+
+    state.vectorNav.quat.normalize();
+
+    state.vectorNav.gyro.x() = imu_sensor_->AngularVelocity()[0];
+    state.vectorNav.gyro.y() = imu_sensor_->AngularVelocity()[1];
+    state.vectorNav.gyro.z() = imu_sensor_->AngularVelocity()[2];
+
+    state.vectorNav.accelerometer.x() = imu_sensor_->LinearAcceleration()[0];
+    state.vectorNav.accelerometer.y() = imu_sensor_->LinearAcceleration()[1];
+    state.vectorNav.accelerometer.z() = imu_sensor_->LinearAcceleration()[2];
     
-    // Read gamepad command if gamepad command is received by lcmhandler
-    if(lcmhandler_->HasEvent()) {
-      simToRobot.gamepadCommand = lcmhandler_->ReceiveGPC();
-      simparam_->LcmHasEvent();
+    /************to  controller by spiDate************/
+    for (uint i = 0; i < 4; i++)
+    {
+      state.spiData.q_abad[i] = q_ctrl_[3 * i + 0];
+      state.spiData.q_hip[i] = q_ctrl_[3 * i + 1];
+      state.spiData.q_knee[i] = q_ctrl_[3 * i + 2];
+      state.spiData.qd_abad[i] = dq_ctrl_[3 * i + 0];
+      state.spiData.qd_hip[i] = dq_ctrl_[3 * i + 1];
+      state.spiData.qd_knee[i] = dq_ctrl_[3 * i + 2];
+      state.spiData.tau_abad[i] = tau_ctrl_[3 * i + 0];
+      state.spiData.tau_hip[i] = tau_ctrl_[3 * i + 1];
+      state.spiData.tau_knee[i] = tau_ctrl_[3 * i + 2];
     }
 
-    // Send data of robot state by sharedmemory to contorl program 
-    simparam_->SendSMData(simToRobot);
+    // Body states read by GetBodyStates this control tick
+    state.cheaterState.position.x() = base_pose_.Pos()[0];
+    state.cheaterState.position.y() = base_pose_.Pos()[1];
+    state.cheaterState.position.z() = base_pose_.Pos()[2];
+    state.cheaterState.orientation[0] = base_pose_.Rot().W();
+    state.cheaterState.orientation[1] = base_pose_.Rot().X();
+    state.cheaterState.orientation[2] = base_pose_.Rot().Y();
+    state.cheaterState.orientation[3] = base_pose_.Rot().Z();
+
+    Eigen::Quaterniond q(base_pose_.Rot().W(),
+                        base_pose_.Rot().X(),
+                        base_pose_.Rot().Y(),
+                        base_pose_.Rot().Z());
+
+    state.cheaterState.vBody.x() = base_vel_[0];
+    state.cheaterState.vBody.y() = base_vel_[1];
+    state.cheaterState.vBody.z() = base_vel_[2];
+    state.cheaterState.omegaBody.x() = base_omega_[0];
+    state.cheaterState.omegaBody.y() = base_omega_[1];
+    state.cheaterState.omegaBody.z() = base_omega_[2];
+
+    state.cheaterState.vBody = q.conjugate() * state.cheaterState.vBody;
+    state.cheaterState.omegaBody = q.conjugate() * state.cheaterState.omegaBody;
+    
+    // Read gamepad command if gamepad command is received by lcmhandler
+    lcmhandler_->ReceiveGPC(state.gamepadCommand);
+
+    // Hand the state written above to the control program
+    simparam_->CommitState();
 
   }
 
-  void LeggedPlugin::SetJointCom()
+  void LeggedPlugin::ReceiveCommand()
   {
     // Receive joint command by sharedmemory from contorl program 
-    SpiCommand cmd = simparam_->ReceiveSMData();
+    if (cmd_queue_size_ == cmd_queue_.size()) {
+      cmd_queue_head_ = (cmd_queue_head_ + 1) % cmd_queue_.size();
+      cmd_queue_size_--;
+    }
+    std::pair<long, SpiCommand> &entry = cmd_queue_[(cmd_queue_head_ + cmd_queue_size_) % cmd_queue_.size()];
+    entry.first = step_count_ + command_delay_;
+    entry.second = simparam_->CommandView();
+    cmd_queue_size_++;
+  }
+
+  void LeggedPlugin::SetJointCom()
+  {
+    // Commands whose delay has passed take effect
+    while (cmd_queue_size_ > 0 && cmd_queue_[cmd_queue_head_].first <= step_count_) {
+      cmd_prev_ = cmd_;
+      cmd_ = cmd_queue_[cmd_queue_head_].second;
+      cmd_queue_head_ = (cmd_queue_head_ + 1) % cmd_queue_.size();
+      cmd_queue_size_--;
+      cmd_steps_ = 0;
+    }
+    SpiCommand cmd = cmd_;
+
+    // Move the targets from the previous command to this one over the control period
+    if(command_interpolation_ == CommandInterpolation::LINEAR) {
+      float alpha = std::min(1.f, float(++cmd_steps_) / control_decimation_);
+      for (int i = 0; i < 4; i++) {
+        cmd.q_des_abad[i] = cmd_prev_.q_des_abad[i] + alpha * (cmd.q_des_abad[i] - cmd_prev_.q_des_abad[i]);
+        cmd.q_des_hip[i] = cmd_prev_.q_des_hip[i] + alpha * (cmd.q_des_hip[i] - cmd_prev_.q_des_hip[i]);
+        cmd.q_des_knee[i] = cmd_prev_.q_des_knee[i] + alpha * (cmd.q_des_knee[i] - cmd_prev_.q_des_knee[i]);
+        cmd.qd_des_abad[i] = cmd_prev_.qd_des_abad[i] + alpha * (cmd.qd_des_abad[i] - cmd_prev_.qd_des_abad[i]);
+        cmd.qd_des_hip[i] = cmd_prev_.qd_des_hip[i] + alpha * (cmd.qd_des_hip[i] - cmd_prev_.qd_des_hip[i]);
+        cmd.qd_des_knee[i] = cmd_prev_.qd_des_knee[i] + alpha * (cmd.qd_des_knee[i] - cmd_prev_.qd_des_knee[i]);
+      }
+    }
 
-    // Calculate motor torque by joint command 
+    // Joint torques from the spine boards, PD law or softstop, limited by the enable flags
     for (int i = 0; i < 4; i++) {
-      unsigned int index = 0;
-      double abad_effort = cmd.kp_abad[i] * (cmd.q_des_abad[i] - q_ctrl_[kleg_map[i]*3]) + cmd.kd_abad[i] * (cmd.qd_des_abad[i] - dq_ctrl_[kleg_map[i]*3]) + cmd.tau_abad_ff[i];
-      double hip_effort = -(cmd.kp_hip[i] * (cmd.q_des_hip[i] - q_ctrl_[kleg_map[i]*3+1]) + cmd.kd_hip[i] * (cmd.qd_des_hip[i] - dq_ctrl_[kleg_map[i]*3+1]) + cmd.tau_hip_ff[i]);
-      double knee_effort = -(cmd.kp_knee[i] * (cmd.q_des_knee[i] - q_ctrl_[kleg_map[i]*3+2]) + cmd.kd_knee[i] * (cmd.qd_des_knee[i] - dq_ctrl_[kleg_map[i]*3+2]) + cmd.tau_knee_ff[i]);
+      spi_data_.q_abad[i] = q_ctrl_[i*3];
+      spi_data_.q_hip[i] = q_ctrl_[i*3+1];
+      spi_data_.q_knee[i] = q_ctrl_[i*3+2];
+      spi_data_.qd_abad[i] = dq_ctrl_[i*3];
+      spi_data_.qd_hip[i] = dq_ctrl_[i*3+1];
+      spi_data_.qd_knee[i] = dq_ctrl_[i*3+2];
+    }
+    spine_board_.cmd = &cmd;
+    spine_board_.data = &spi_data_;
+    spine_board_.run();
 
+    ActuatorBatch::Array12d effort;
+    ActuatorBatch::Array12d qd;
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 3; j++) {
+        effort[i*3+j] = joint_sign_[i*3+j] * spine_board_.torque_out[j][i];
+      }
+    }
+    for (int i = 0; i < 12; i++) {
+      qd[i] = dq_[i];
+    }
 
-      if(use_TNcurve_motormodel_){
-          abad_effort = motor_.GetTorque(abad_effort, dq_[kleg_map[i]*3]);
-          hip_effort = motor_.GetTorque(hip_effort, dq_[kleg_map[i]*3+1]);
-          knee_effort = motor_.GetTorque(knee_effort, dq_[kleg_map[i]*3+2]);
-        }
-        
-      if(use_currentloop_response_){
-          abad_effort = motor_.CerrentLoopResponse(abad_effort,dq_[kleg_map[i]*3],kleg_map[i]*3);
-          hip_effort = motor_.CerrentLoopResponse(hip_effort,dq_[kleg_map[i]*3+1],kleg_map[i]*3+1);
-          knee_effort = motor_.CerrentLoopResponse(knee_effort,dq_[kleg_map[i]*3+2],kleg_map[i]*3+2);
-       }
+    // Motor model of all joints at once
+    if(use_TNcurve_motormodel_){
+      motor_.GetTorque(effort, qd);
+    }
+    if(use_currentloop_response_){
+      motor_.CurrentLoopResponse(effort);
+    }
 
-      joint_map_[joint_names_[kleg_map[i]*3]]->SetForce(index, abad_effort);
-      joint_map_[joint_names_[kleg_map[i]*3+1]]->SetForce(index, hip_effort);
-      joint_map_[joint_names_[kleg_map[i]*3+2]]->SetForce(index, knee_effort);    
+    for (int i = 0; i < 12; i++) {
+      unsigned int index = 0;
+      joints_[i]->SetForce(index, effort[i]);
     }
 
   }
@@ -401,34 +683,127 @@ namespace gazebo
     _contact_force contact_force_hl_;
     _contact_force contact_force_hr_;
 
-    contact_force_fl_= GetContactForce(contact_sensor_fl_->Contacts());
-    contact_force_fr_= GetContactForce(contact_sensor_fr_->Contacts());
-    contact_force_hl_= GetContactForce(contact_sensor_hl_->Contacts());
-    contact_force_hr_= GetContactForce(contact_sensor_hr_->Contacts());
+    contact_force_fl_= GetContactForce(contact_sensor_fl_->Contacts(), foot_links_[0]);
+    contact_force_fr_= GetContactForce(contact_sensor_fr_->Contacts(), foot_links_[1]);
+    contact_force_hl_= GetContactForce(contact_sensor_hl_->Contacts(), foot_links_[2]);
+    contact_force_hr_= GetContactForce(contact_sensor_hr_->Contacts(), foot_links_[3]);
 
     // Transfer contact forces to body coordnate
+    Eigen::Vector3d force_fl = forceToBody(contact_force_fl_);
+    Eigen::Vector3d force_fr = forceToBody(contact_force_fr_);
+    Eigen::Vector3d force_hl = forceToBody(contact_force_hl_);
+    Eigen::Vector3d force_hr = forceToBody(contact_force_hr_);
     for(unsigned int i=0; i<3; i++) {
-      lcm_sim_handler_.f_foot[i] = LeggedPlugin::forceToBody(contact_force_fl_,model_)[i];
-      lcm_sim_handler_.f_foot[i+3] = LeggedPlugin::forceToBody(contact_force_fr_,model_)[i];
-      lcm_sim_handler_.f_foot[i+6] = LeggedPlugin::forceToBody(contact_force_hl_,model_)[i];
-      lcm_sim_handler_.f_foot[i+9] = LeggedPlugin::forceToBody(contact_force_hr_,model_)[i];
+      lcm_sim_handler_.f_foot[i] = force_fl[i];
+      lcm_sim_handler_.f_foot[i+3] = force_fr[i];
+      lcm_sim_handler_.f_foot[i+6] = force_hl[i];
+      lcm_sim_handler_.f_foot[i+9] = force_hr[i];
+      }
+
+  }
+
+  bool LeggedPlugin::InitPhysicsContacts()
+  {
+    // Foot collisions are the ones monitored by the contact sensors, or any
+    // collision of the foot link named after the foot without them
+    gazebo::sensors::ContactSensorPtr contact_sensors[4] = {contact_sensor_fl_, contact_sensor_fr_, contact_sensor_hl_, contact_sensor_hr_};
+    std::vector<std::string> collision_names;
+    for (int i = 0; i < 4; i++) {
+      if (!foot_links_[i]) {
+        return false;
+      }
+      for (auto &collision : foot_links_[i]->GetCollisions()) {
+        bool is_foot = collision->GetName().find("foot") != std::string::npos;
+        if (contact_sensors[i]) {
+          is_foot = false;
+          for (unsigned int j = 0; j < contact_sensors[i]->GetCollisionCount(); j++) {
+            is_foot |= contact_sensors[i]->GetCollisionName(j) == collision->GetScopedName();
+          }
+        }
+        if (is_foot) {
+          foot_contacts_[i].collisions.push_back(collision.get());
+          collision_names.push_back(collision->GetScopedName());
+          SIM_LOG_INFO("Foot contact collision found: %s", collision->GetScopedName().c_str());
+        }
+      }
+      if (foot_contacts_[i].collisions.empty()) {
+        return false;
       }
+    }
 
+    // A filter makes the contact manager keep these contacts even without subscribers
+    contact_manager_ = model_->GetWorld()->Physics()->GetContactManager();
+    contact_manager_->CreateFilter(model_->GetName() + "_foot_contacts", collision_names);
+    return true;
   }
 
-  Eigen::Vector3d LeggedPlugin::forceToBody(_contact_force &_contact_force, physics::ModelPtr model_)
+  void LeggedPlugin::AccumulatePhysicsContacts()
+  {
+    const std::vector<physics::Contact*> &contacts = contact_manager_->GetContacts();
+    unsigned int count = contact_manager_->GetContactCount();
+    for (unsigned int i = 0; i < count; i++) {
+      const physics::Contact *contact = contacts[i];
+      for (int foot = 0; foot < 4; foot++) {
+        _foot_contact &foot_contact = foot_contacts_[foot];
+        bool first = false;
+        bool second = false;
+        for (physics::Collision *collision : foot_contact.collisions) {
+          first |= contact->collision1 == collision;
+          second |= contact->collision2 == collision;
+        }
+        if (!first && !second) {
+          continue;
+        }
+
+        // Wrenches are in the frame of the link, rotate them once per foot
+        ignition::math::Quaterniond rot = foot_links_[foot]->WorldPose().Rot();
+        for (int j = 0; j < contact->count; j++) {
+          ignition::math::Vector3d force = rot.RotateVector(first ? contact->wrench[j].body1Force : contact->wrench[j].body2Force);
+          double normal = std::abs(force.Dot(contact->normals[j]));
+          foot_contact.force += force;
+          foot_contact.cop += normal * contact->positions[j];
+          foot_contact.normal += normal;
+        }
+        break;
+      }
+    }
+    contact_steps_++;
+  }
+
+  void LeggedPlugin::GetPhysicsContactForce4()
+  {
+    // Transfer contact forces and points to body coordnate, relative to the base
+    ignition::math::Pose3d base_pose = base_link_->WorldPose();
+    for (int foot = 0; foot < 4; foot++) {
+      _foot_contact &foot_contact = foot_contacts_[foot];
+      ignition::math::Vector3d force = base_pose.Rot().RotateVectorReverse(foot_contact.force / std::max(contact_steps_, 1));
+      ignition::math::Vector3d cop;
+      if (foot_contact.normal > 1e-6) {
+        cop = base_pose.Rot().RotateVectorReverse(foot_contact.cop / foot_contact.normal - base_pose.Pos());
+      }
+      for (int i = 0; i < 3; i++) {
+        lcm_sim_handler_.f_foot[foot * 3 + i] = force[i];
+        lcm_sim_handler_.p_foot[foot * 3 + i] = cop[i];
+      }
+      foot_contact.force = ignition::math::Vector3d::Zero;
+      foot_contact.cop = ignition::math::Vector3d::Zero;
+      foot_contact.normal = 0;
+    }
+    contact_steps_ = 0;
+  }
+
+  Eigen::Vector3d LeggedPlugin::forceToBody(const _contact_force &_contact_force)
   {
     // Transfer contact forces to body coordnate
     Eigen::Vector3d force;
     if(foot_counter_ >3)
     foot_counter_ =0;
-      if(_contact_force.parent_name=="") {
+      if(!_contact_force.parent_link) {
         force << 0,0,0;
       }
       else{
-        auto parent_link = model_->GetLink(_contact_force.parent_name);
         ignition::math::Pose3d parent_pose;
-        parent_pose = parent_link->WorldPose();
+        parent_pose = _contact_force.parent_link->WorldPose();
         Eigen::Quaterniond q(
                            parent_pose.Rot().W(),                                                 
                            parent_pose.Rot().X(),
@@ -450,22 +825,155 @@ namespace gazebo
 
   void LeggedPlugin::ForceHandler(const cyberdog_msg::msg::ApplyForce::SharedPtr msg)
   {
-    // Handle ApplyForce topic message 
-    apply_force_.name = msg -> link_name;
-    apply_force_.time = msg -> time;
+    force_mailbox_.Put(*msg);
+  }
+
+  void LeggedPlugin::ReceiveForce()
+  {
+    cyberdog_msg::msg::ApplyForce msg;
+    if (!force_mailbox_.Take(msg)) {
+      return;
+    }
+    apply_force_.name = msg.link_name;
+    apply_force_.link = model_->GetLink(apply_force_.name);
+    apply_force_.end_time = apply_force_.link ? model_->GetWorld()->SimTime().Double() + msg.time : 0;
+    if (!apply_force_.link) {
+      SIM_LOG_ERROR("[Simulation] ApplyForce: no link named %s", apply_force_.name.c_str());
+    }
     for(int i=0;i<3;i++) {
-      apply_force_.force[i]=msg -> force[i];
-      apply_force_.rel_pos[i]=msg -> rel_pos[i];
+      apply_force_.force[i]=msg.force[i];
+      apply_force_.rel_pos[i]=msg.rel_pos[i];
+    }
+  }
+
+  void LeggedPlugin::StepHandler(const std::shared_ptr<cyberdog_msg::srv::StepSimulation::Request> request,
+                                 std::shared_ptr<cyberdog_msg::srv::StepSimulation::Response> response)
+  {
+    // Called from the background executor, World::Step blocks until the steps are done
+    physics::WorldPtr world = model_->GetWorld();
+    response->success = world->IsPaused();
+    if (response->success) {
+      world->Step(request->steps);
+    }
+    else {
+      SIM_LOG_WARN("[Simulation] StepSimulation: pause the world before stepping it");
+    }
+    response->iterations = world->Iterations();
+    response->sim_time = world->SimTime().Double();
+  }
+
+  void LeggedPlugin::ReportStepRate()
+  {
+    auto now = std::chrono::steady_clock::now();
+    double wall_time = std::chrono::duration<double>(now - report_wall_time_).count();
+    if (wall_time < 5.0) {
+      return;
+    }
+    double sim_time = model_->GetWorld()->SimTime().Double();
+    if (report_step_count_ > 0) {
+      SIM_LOG_INFO("[Simulation] %ld steps/s, real time factor %g", long((step_count_ - report_step_count_) / wall_time),
+                   (sim_time - report_sim_time_) / wall_time);
+    }
+    report_wall_time_ = now;
+    report_sim_time_ = sim_time;
+    report_step_count_ = step_count_;
+  }
+
+  void LeggedPlugin::ReportActuatorLimits()
+  {
+    const ActuatorCounters &counters = motor_.Counters();
+    double sim_time = model_->GetWorld()->SimTime().Double();
+    if (sim_time - actuator_report_time_ < 1.0 || (counters.speed_limit == actuator_counters_.speed_limit &&
+        counters.torque_limit == actuator_counters_.torque_limit && counters.current_limit == actuator_counters_.current_limit)) {
+      return;
+    }
+    SIM_LOG_INFO("[Simulation] actuator limits in the last %g s: %ld over speed, %ld torque clipped, %ld current rate limited",
+                 sim_time - actuator_report_time_, long(counters.speed_limit - actuator_counters_.speed_limit),
+                 long(counters.torque_limit - actuator_counters_.torque_limit), long(counters.current_limit - actuator_counters_.current_limit));
+    actuator_report_time_ = sim_time;
+    actuator_counters_ = counters;
+  }
+
+  void LeggedPlugin::ApplyRealTime()
+  {
+    realtime_applied_ = true;
+    if (sim_cpus_ != 0) {
+      int error = SetThreadAffinity(sim_cpus_);
+      SIM_LOG_INFO("[Simulation] update thread on cpus %s: %s", CpuListString(sim_cpus_).c_str(), error ? strerror(error) : "ok");
+    }
+    if (rt_priority_ > 0) {
+      int error = SetThreadFifo(rt_priority_);
+      SIM_LOG_INFO("[Simulation] update thread SCHED_FIFO %d: %s", rt_priority_, error ? strerror(error) : "ok");
+    }
+  }
+
+  void LeggedPlugin::ReportProfile()
+  {
+    cyberdog_msg::msg::TickProfile msg;
+    msg.period = profiler_.Roll();
+    for (int i = 0; i < kNumTickPhases; i++) {
+      const TickHistogram &histogram = profiler_.Interval(TickPhase(i));
+      msg.phase.push_back(kTickPhaseNames[i]);
+      msg.count.push_back(histogram.Count());
+      msg.mean.push_back(histogram.Mean() * 1e-3);
+      msg.p50.push_back(histogram.Quantile(0.5) * 1e-3);
+      msg.p99.push_back(histogram.Quantile(0.99) * 1e-3);
+      msg.max.push_back(histogram.Max() * 1e-3);
+    }
+    profile_pub_->publish(msg);
+  }
+
+  void LeggedPlugin::WatchController()
+  {
+    if(controller_connected_) {
+      controller_connected_ = false;
+      HoldJoints();
+      SIM_LOG_WARN("[Simulation] control program disconnected, damping the joints with kd %g", safe_hold_kd_);
+      PublishConnection(cyberdog_msg::msg::ControllerConnection::DISCONNECTED, disconnect_reason_);
+      return;
+    }
+    if(simparam_->PollReconnect()) {
+      controller_connected_ = true;
+      // the first commands start from where the joints are now
+      HoldJoints();
+      SIM_LOG_INFO("[Simulation] control program reconnected");
+      PublishConnection(cyberdog_msg::msg::ControllerConnection::CONNECTED, "control program attached");
+    }
+  }
+
+  void LeggedPlugin::HoldJoints()
+  {
+    SpiCommand hold;
+    for (int i = 0; i < 4; i++) {
+      hold.q_des_abad[i] = q_ctrl_[i*3];
+      hold.q_des_hip[i] = q_ctrl_[i*3+1];
+      hold.q_des_knee[i] = q_ctrl_[i*3+2];
+      hold.kd_abad[i] = safe_hold_kd_;
+      hold.kd_hip[i] = safe_hold_kd_;
+      hold.kd_knee[i] = safe_hold_kd_;
+      hold.flags[i] = 1;
     }
+    cmd_queue_size_ = 0;
+    cmd_ = hold;
+    cmd_prev_ = hold;
+  }
+
+  void LeggedPlugin::PublishConnection(uint8_t state, const std::string &reason)
+  {
+    cyberdog_msg::msg::ControllerConnection msg;
+    msg.state = state;
+    msg.reason = reason;
+    msg.sim_time = model_->GetWorld()->SimTime().Double();
+    connection_pub_->publish(msg);
   }
 
   void LeggedPlugin::ApplyForce()
   {
+    ReceiveForce();
+
     // Apply force to the links
-    if(apply_force_.time > 0) {
-      apply_force_.time = apply_force_.time - 0.001;
-      gazebo::physics::LinkPtr link=model_->GetLink(apply_force_.name);
-      link->AddForceAtRelativePosition(apply_force_.force,apply_force_.rel_pos);
+    if(model_->GetWorld()->SimTime().Double() < apply_force_.end_time) {
+      apply_force_.link->AddForceAtRelativePosition(apply_force_.force,apply_force_.rel_pos);
     }
   }
 
@@ -19,55 +19,106 @@
 
 namespace gazebo
 {
-    SimParam::SimParam(std::string model_name, NodeExc* node_executor)
-    :user_parameters_("user-parameters")
+    /**
+     * @brief Unmap and unlink a segment created by CreateNew, a failure is
+     *        logged instead of thrown since it runs from the destructor
+     */
+    template < typename T >
+    static void CloseSegment( SharedMemoryObject< T >& memory )
+    {
+        try {
+            memory.CloseNew();
+        }
+        catch ( const std::exception& e ) {
+            SIM_LOG_ERROR( "[Simulation] cannot close shared memory: %s", e.what() );
+        }
+    }
+
+    SimParam::SimParam(std::string model_name, NodeExc* node_executor, SharedMemorySyncMode sync_mode, int instance,
+                       const SharedMemoryOptions& shm_options)
+    :instance_(instance), user_parameters_("user-parameters")
     {
         robotType = RobotType::MINI_CYBERDOG;
 
         LoadYaml();
 
-        //build a sharedmemory with name as "development-simulator"
-        printf( "[Simulation] Setup shared memory...\n" );
-        shared_memory_.CreateNew( DEVELOPMENT_SIMULATOR_SHARED_MEMORY_NAME, true );
-        shared_memory_.Init(true );
+        //build a sharedmemory with name as "development-simulator", suffixed by the instance if there is one
+        SIM_LOG_INFO( "[Simulation] Setup shared memory..." );
+        shared_memory_.CreateNew( InstanceScopedName( DEVELOPMENT_SIMULATOR_SHARED_MEMORY_NAME, instance ), true, shm_options );
+        shared_memory_.Init(true, sync_mode, instance);
 
         shared_memory_().simToRobot.robotType  = robotType;
 
-        gazebo_node_ = std::make_shared<GazeboNode>("gazebo_node");
+        // controller timing, readable by other processes while the simulation runs
+        stats_memory_.CreateNew( InstanceScopedName( DEVELOPMENT_SIMULATOR_STATS_SHARED_MEMORY_NAME, instance ), true );
+        stats_memory_().timing.minNs = ~u64( 0 );
+
+        gazebo_node_ = node_executor->CreateNode("gazebo_node");
         para_sub_=gazebo_node_->create_subscription<cyberdog_msg::msg::YamlParam>("yaml_parameter", 10, std::bind(&SimParam::HandleYamlParam,this,std::placeholders::_1));
 
         node_executor_ = node_executor;
         node_executor_->AddNode(gazebo_node_);
     }
 
+    SimParam::~SimParam()
+    {
+        CloseSegment( stats_memory_ );
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        if ( visualization_mapped_ ) {
+            CloseSegment( visualization_memory_ );
+        }
+        if ( parameter_table_mapped_ ) {
+            CloseSegment( parameter_table_memory_ );
+        }
+#endif
+    }
+
     void SimParam::LoadYaml()
     {
-        printf( "[Simulation] Loading YAML files\n" );
+        SIM_LOG_INFO( "[Simulation] Loading YAML files" );
         user_parameters_.DefineAndInitializeFromYamlFile( GetLocoConfigDirectoryPath() + "cyberdog2-ctrl-user-parameters.yaml" );
 
         if ( !user_parameters_.IsFullyInitialized() ) {
-        printf( "Not all user parameters were initialized. Missing:\n%s\n", user_parameters_.GenerateUnitializedList().c_str() );
+        SIM_LOG_WARN( "Not all user parameters were initialized. Missing:\n%s", user_parameters_.GenerateUnitializedList().c_str() );
         throw std::runtime_error( "not all parameters initialized from ini file" );
         }
 
-        printf( "[Simulation] User-parameter is loaded\n" );
+        SIM_LOG_INFO( "[Simulation] User-parameter is loaded" );
         robot_parameters_.InitializeFromYamlFile( GetLocoConfigDirectoryPath() + "robot-defaults.yaml" );
 
         if ( !robot_parameters_.IsFullyInitialized() ) {
-        printf( "Not all robot control parameters were initialized. Missing:\n%s\n", robot_parameters_.GenerateUnitializedList().c_str() );
+        SIM_LOG_WARN( "Not all robot control parameters were initialized. Missing:\n%s", robot_parameters_.GenerateUnitializedList().c_str() );
         throw std::runtime_error( "not all parameters initialized from ini file" );
         }
-        printf( "[Simulation] Control-parameter is loaded\n" );
+        SIM_LOG_INFO( "[Simulation] Control-parameter is loaded" );
 
     }
 
+    bool SimParam::LoadControllerLibrary(const std::string& path, const std::string& args)
+    {
+        std::string error;
+        if ( !controller_library_.Load( path, args, shared_memory_(), error ) ) {
+            SIM_LOG_ERROR( "[Simulation] cannot load controller library: %s, waiting for a control program on the shared memory",
+                           error.c_str() );
+            return false;
+        }
+        SIM_LOG_INFO( "[Simulation] control program %s runs in the simulator process", path.c_str() );
+        return true;
+    }
+
     void SimParam::FirstRun()
     {
+        // a library controller is called directly, there is nothing to wait for
+        if ( controller_library_.Loaded() ) {
+            connected_ = true;
+            UploadControlParameters();
+            return;
+        }
         
         shared_memory_().simToRobot.mode = SimulatorMode::DO_NOTHING;
         shared_memory_.SimulatorIsDone();
 
-        std::cout << "[Simulation] Waiting for robot..." << std::endl;
+        SIM_LOG_INFO( "[Simulation] Waiting for robot..." );
 
         // this loop will check to see if the robot is connected at 10 Hz
         // doing this in a loop allows us to click the "stop" button in the GUI
@@ -79,22 +130,191 @@ namespace gazebo
             }
             usleep( 100000 );
         }
-        std::cout << "Success! the robot is alive" << std::endl;
+        SIM_LOG_INFO( "Success! the robot is alive" );
+        connected_ = true;
+
+        UploadControlParameters();
+    }
+
+    bool SimParam::PollReconnect()
+    {
+        if ( connected_ ) {
+            return true;
+        }
+        if ( controller_library_.Loaded() ) {
+            // a library controller that failed is created anew after a second
+            if ( MonotonicNanoseconds() - disconnect_time_ < 1000000000 ) {
+                return false;
+            }
+            if ( !controller_library_.Restart( shared_memory_() ) ) {
+                disconnect_time_ = MonotonicNanoseconds();
+                return false;
+            }
+            SIM_LOG_INFO( "[Simulation] library controller restarted" );
+            connected_ = true;
+
+            UploadControlParameters();
+            return connected_;
+        }
+        if ( !probe_pending_ ) {
+            // late answers of the lost control program are dropped for one
+            // timeout, at most a second, before a new one is asked for
+            if ( shared_memory_.TryWaitForRobot() ) {
+                SIM_LOG_INFO( "[Simulation] dropped a late answer of the lost control program" );
+            }
+            u64 grace = timeout_ns_ > 0 && timeout_ns_ < 1000000000 ? timeout_ns_ : 1000000000;
+            if ( MonotonicNanoseconds() - disconnect_time_ < s64( grace ) ) {
+                return false;
+            }
+            // signals left for the lost control program are answered by the
+            // next one before the probe, those answers are skipped
+            shared_memory_().simToRobot.mode = SimulatorMode::DO_NOTHING;
+            probe_stale_answers_ = shared_memory_.SignalsPendingForRobot();
+            shared_memory_.SimulatorIsDone();
+            probe_pending_ = true;
+            SIM_LOG_INFO( "[Simulation] Waiting for robot..." );
+            return false;
+        }
+        while ( probe_stale_answers_ > 0 && shared_memory_.TryWaitForRobot() ) {
+            probe_stale_answers_--;
+        }
+        if ( probe_stale_answers_ > 0 || !shared_memory_.TryWaitForRobot() ) {
+            return false;
+        }
+        probe_pending_ = false;
+        SIM_LOG_INFO( "[Simulation] the robot is alive again" );
+        connected_ = true;
+
+        UploadControlParameters();
+        return connected_;
+    }
+
+    void SimParam::UploadControlParameters()
+    {
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        // robots that know kSET_ALL_PARAMS say so when they attach
+        if ( shared_memory_().robotToSim.controlParameterTableSupport == kCONTROL_PARAMETER_TABLE_MAGIC ) {
+            SIM_LOG_INFO( "[Simulation] Send all control parameters to robot in one transaction..." );
+            SendAllControlParameters();
+            return;
+        }
+#endif
 
-        printf( "[Simulation] Send robot control parameters to robot...\n" );
+        SIM_LOG_INFO( "[Simulation] Send robot control parameters to robot..." );
         for ( auto& kv : robot_parameters_.collection_.map_ ) {
+            if ( !connected_ ) {
+                return;
+            }
             SendControlParameter( kv.first, kv.second->Get( kv.second->kind_ ), kv.second->kind_, false );
         }
 
         for ( auto& kv : user_parameters_.collection_.map_ ) {
+            if ( !connected_ ) {
+                return;
+            }
             SendControlParameter( kv.first, kv.second->Get( kv.second->kind_ ), kv.second->kind_, true );
         }
     }
 
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+    std::vector< ControlParameterStatus > SimParam::SendAllControlParameters() {
+        MapControlParameterTable();
+        ControlParameterTable& table = parameter_table_memory_();
+        std::vector< ControlParameterStatus > status;
+        std::vector< std::string > names;
+        table.count = 0;
+
+        auto add_collection = [ & ]( ControlParameterCollection& collection, bool isUser ) {
+            for ( auto& kv : collection.map_ ) {
+                ControlParameterTableEntry& entry = table.entries[ table.count++ ];
+                strncpy( entry.name, kv.first.c_str(), kCONTROL_PARAMETER_MAXIMUM_NAME_LENGTH - 1 );
+                entry.name[ kCONTROL_PARAMETER_MAXIMUM_NAME_LENGTH - 1 ] = '\0';
+                entry.value         = kv.second->Get( kv.second->kind_ );
+                entry.parameterKind = kv.second->kind_;
+                entry.isUser        = isUser;
+                entry.status        = ControlParameterStatus::kPENDING;
+                names.push_back( kv.first );
+
+                // a full table is committed before it is refilled
+                if ( table.count == kCONTROL_PARAMETER_TABLE_SIZE && !CommitControlParameterTable( status ) ) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        if ( !add_collection( robot_parameters_.collection_, false ) || !add_collection( user_parameters_.collection_, true ) ) {
+            return status;
+        }
+        if ( table.count && !CommitControlParameterTable( status ) ) {
+            return status;
+        }
+
+        size_t failed = 0;
+        for ( size_t i = 0; i < status.size(); i++ ) {
+            if ( status[ i ] != ControlParameterStatus::kOK ) {
+                SIM_LOG_WARN( "[Simulation] robot rejected control parameter %s (status %d)", names[ i ].c_str(), ( int )status[ i ] );
+                failed++;
+            }
+        }
+        SIM_LOG_INFO( "[Simulation] %ld control parameters sent, %ld rejected", status.size(), failed );
+        return status;
+    }
+
+    bool SimParam::CommitControlParameterTable( std::vector< ControlParameterStatus >& status ) {
+        ControlParameterTable&    table    = parameter_table_memory_();
+        ControlParameterRequest&  request  = shared_memory_().simToRobot.controlParameterRequest;
+        ControlParameterResponse& response = shared_memory_().robotToSim.controlParameterResponse;
+
+        // a pipelined controller tick must finish before the robot takes requests
+        if ( CollectSMData() == CollectResult::kFailed ) {
+            return false;
+        }
+
+        // first check no pending message
+        assert( request.requestNumber == response.requestNumber );
+
+        request.requestNumber++;
+        request.requestKind = ControlParameterRequestKind::kSET_ALL_PARAMS;
+        request.name[ 0 ]   = '\0';
+
+        shared_memory_().simToRobot.mode = SimulatorMode::RUN_CONTROL_PARAMETERS;
+        if ( !RunRobot() ) {
+            HandleControlError();
+            return false;
+        }
+
+        assert( response.requestNumber == request.requestNumber );
+        assert( response.requestKind == ControlParameterRequestKind::kSET_ALL_PARAMS );
+
+        for ( u64 i = 0; i < table.count; i++ ) {
+            status.push_back( table.entries[ i ].status );
+        }
+        table.count = 0;
+        return true;
+    }
+
+    void SimParam::MapControlParameterTable()
+    {
+        if ( parameter_table_mapped_ ) {
+            return;
+        }
+        SIM_LOG_INFO( "[Simulation] Setup control parameter table shared memory..." );
+        parameter_table_memory_.CreateNew( InstanceScopedName( DEVELOPMENT_SIMULATOR_PARAMETER_TABLE_SHARED_MEMORY_NAME, instance_ ), true );
+        parameter_table_mapped_ = true;
+        shared_memory_().simToRobot.controlParameterTableEnabled = 1;
+    }
+#endif
+
     void SimParam::SendControlParameter( const std::string& name, ControlParameterValue value, ControlParameterValueKind kind, bool isUser ) {
         ControlParameterRequest&  request  = shared_memory_().simToRobot.controlParameterRequest;
         ControlParameterResponse& response = shared_memory_().robotToSim.controlParameterResponse;
 
+        // a pipelined controller tick must finish before the robot takes requests
+        if ( CollectSMData() == CollectResult::kFailed ) {
+            return;
+        }
+
         // first check no pending message
         assert( request.requestNumber == response.requestNumber );
 
@@ -106,18 +326,14 @@ namespace gazebo
         strcpy( request.name, name.c_str() );
         request.value         = value;
         request.parameterKind = kind;
-        printf( "%s\n", request.ToString().c_str() );
+        SIM_LOG_DEBUG( "%s", request.ToString().c_str() );
 
-        // run robot:
+        // run robot and wait for it to finish
         shared_memory_().simToRobot.mode = SimulatorMode::RUN_CONTROL_PARAMETERS;
-        shared_memory_.SimulatorIsDone();
-
-        // wait for robot code to finish
-        if ( shared_memory_.WaitForRobotWithTimeout() ) {
+        if ( RunRobot() ) {
         }
         else {
             HandleControlError();
-            request.requestNumber = response.requestNumber;  // so if we come back we won't be off by 1
             return;
         }
 
@@ -129,52 +345,211 @@ namespace gazebo
         assert( std::string( response.name ) == request.name );
     }
 
+    bool SimParam::RunRobot() {
+        if ( controller_library_.Loaded() ) {
+#ifdef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+            return controller_library_.Run( shared_memory_(), nullptr );
+#else
+            return controller_library_.Run( shared_memory_(), parameter_table_mapped_ ? &parameter_table_memory_() : nullptr );
+#endif
+        }
+        shared_memory_.SimulatorIsDone();
+        return WaitForController();
+    }
+
+    bool SimParam::WaitForController() {
+        if ( timeout_ns_ == 0 ) {
+            return shared_memory_.WaitForRobotWithTimeout();
+        }
+        return shared_memory_.WaitForRobotWithTimeout( timeout_ns_ / 1000000000, timeout_ns_ % 1000000000 );
+    }
+
     void SimParam::HandleControlError() {
-        want_stop_  = true;
         running_   = false;
         connected_ = false;
+        std::string reason;
         if ( !shared_memory_().robotToSim.errorMessage[ 0 ] ) {
-            printf( "[ERROR] Control code timed-out!\n" );
-            error_callback_( "Control code has stopped responding without giving an error message.\nIt has likely crashed - "
-                            "check the output of the control code for more information" );
+            SIM_LOG_ERROR( "[ERROR] Control code timed-out! Holding the joints until it reconnects" );
+            reason = "Control code has stopped responding without giving an error message.\nIt has likely crashed - "
+                     "check the output of the control code for more information";
         }
         else {
-            printf( "[ERROR] Control code has an error!\n" );
-            error_callback_( "Control code has an error:\n" + std::string( shared_memory_().robotToSim.errorMessage ) );
+            SIM_LOG_ERROR( "[ERROR] Control code has an error! Holding the joints until it reconnects" );
+            reason = "Control code has an error:\n" + std::string( shared_memory_().robotToSim.errorMessage );
         }
+        ResetConnection();
+        if ( error_callback_ ) {
+            error_callback_( reason );
+        }
+    }
+
+    void SimParam::ResetConnection() {
+        // signals of the lost control program must not be taken for answers of the next one
+        robot_pending_ = false;
+        probe_pending_ = false;
+        shared_memory_.DrainSignals();
+
+        ControlParameterRequest&  request  = shared_memory_().simToRobot.controlParameterRequest;
+        ControlParameterResponse& response = shared_memory_().robotToSim.controlParameterResponse;
+        request.requestNumber = response.requestNumber;  // so if we come back we won't be off by 1
+
+        shared_memory_().simToRobot.mode                        = SimulatorMode::DO_NOTHING;
+        shared_memory_().robotToSim.errorMessage[ 0 ]           = '\0';
+        shared_memory_().robotToSim.spiCommand                  = SpiCommand();
+        disconnect_time_ = MonotonicNanoseconds();
+    }
+
+    bool SimParam::StateWritable()
+    {
+        return connected_ && !robot_pending_ && shared_memory_().simToRobot.mode != SimulatorMode::EXIT;
+    }
+
+    SimulatorStateView SimParam::StateView()
+    {
+        SimulatorToRobotMessage& message = shared_memory_().simToRobot;
+        return SimulatorStateView{ message.vectorNav, message.cheaterState, message.spiData, message.gamepadCommand };
     }
 
-    void SimParam::SendSMData(SimulatorToRobotMessage _SimToRobot)
-    {     
-        if (shared_memory_().simToRobot.mode != SimulatorMode::EXIT)
+    void SimParam::CommitState()
+    {
+        if (!connected_ || shared_memory_().simToRobot.mode == SimulatorMode::EXIT)
         {
-            shared_memory_().simToRobot.cheaterState = _SimToRobot.cheaterState;
-            shared_memory_().simToRobot.spiData = _SimToRobot.spiData;
-            shared_memory_().simToRobot.vectorNav = _SimToRobot.vectorNav;
-            shared_memory_().simToRobot.mode = SimulatorMode::RUN_CONTROLLER;
-            if(lcm_has_event_)
-            {
-                shared_memory_().simToRobot.gamepadCommand = _SimToRobot.gamepadCommand;
-                lcm_has_event_ = false;
-            }
+            return;
+        }
+        shared_memory_().simToRobot.mode = SimulatorMode::RUN_CONTROLLER;
+        shared_memory_().simToRobot.tickSequence = ++tick_sequence_;
+        shared_memory_().simToRobot.tickDeadline = s32( stats_memory_().timing.deadlineNs / 1000 );
+        shared_memory_().simToRobot.tickSendTime = MonotonicNanoseconds();
+        // a library controller runs when the tick is collected
+        if ( !controller_library_.Loaded() ) {
             shared_memory_.SimulatorIsDone();
+        }
+        robot_pending_ = true;
+    }
+
+    CollectResult SimParam::CollectSMData()
+    {
+        if ( !robot_pending_ ) {
+            return CollectResult::kIdle;
+        }
+        robot_pending_ = false;
+        if ( controller_library_.Loaded() ? controller_library_.Run( shared_memory_(), nullptr ) : WaitForController() ) {
+            RecordControllerTiming( MonotonicNanoseconds() );
+            return CollectResult::kCollected;
+        }
+        HandleControlError();
+        return CollectResult::kFailed;
+    }
 
+    void SimParam::RecommendControllerRealTime(int priority, u64 affinity)
+    {
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        shared_memory_().simToRobot.controllerPriority = priority;
+        shared_memory_().simToRobot.controllerAffinity = affinity;
+#else
+        if ( priority > 0 || affinity != 0 ) {
+            SIM_LOG_WARN( "[Simulation] the legacy sharedmemory layout cannot recommend a controller real time configuration" );
         }
-        if ( shared_memory_.WaitForRobotWithTimeout() ) {
+#endif
+    }
+
+    void SimParam::SetControllerTimeout(double seconds)
+    {
+        timeout_ns_ = seconds > 0 ? u64( seconds * 1e9 ) : 0;
+        if ( timeout_ns_ ) {
+            SIM_LOG_INFO( "[Simulation] controller timeout %.3f s", seconds );
         }
         else {
-            HandleControlError();
-            return;
+            SIM_LOG_INFO( "[Simulation] controller timeout disabled" );
+        }
+    }
+
+    void SimParam::SetControllerDeadline(u64 deadline_ns)
+    {
+        stats_memory_().timing.deadlineNs = deadline_ns;
+        SIM_LOG_INFO( "[Simulation] controller deadline %.1f us", deadline_ns * 1e-3 );
+    }
+
+    void SimParam::RecordControllerTiming(s64 now)
+    {
+        const SimulatorToRobotMessage& sim = shared_memory_().simToRobot;
+        ControllerTiming& stats = stats_memory_().timing;
+        u64 round_trip = u64( now - sim.tickSendTime );
+        round_trip_.Record( round_trip );
+        round_trip_sum_ += round_trip;
+
+        // odd sequence while the block is inconsistent
+        stats_memory_().sequence.fetch_add( 1, std::memory_order_acq_rel );
+        stats.ticks++;
+        if ( stats.deadlineNs > 0 && round_trip > stats.deadlineNs ) {
+            stats.deadlineMisses++;
+        }
+        stats.lastNs = round_trip;
+        stats.minNs  = std::min( stats.minNs, round_trip );
+        stats.maxNs  = std::max( stats.maxNs, round_trip );
+        stats.avgNs  = round_trip_sum_ / stats.ticks;
+        if ( ( stats.ticks & 255 ) == 1 ) {
+            stats.p50Ns  = round_trip_.Quantile( 0.5 );
+            stats.p99Ns  = round_trip_.Quantile( 0.99 );
+            stats.p999Ns = round_trip_.Quantile( 0.999 );
         }
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        // control programs that stamp their answer split the round trip up
+        const RobotToSimulatorMessage& robot = shared_memory_().robotToSim;
+        if ( robot.tickEndTime != 0 ) {
+            if ( robot.tickSequence != sim.tickSequence ) {
+                stats.staleReplies++;
+            }
+            else {
+                stats.stampedTicks++;
+                wake_sum_ += robot.tickStartTime - sim.tickSendTime;
+                compute_sum_ += robot.tickEndTime - robot.tickStartTime;
+                return_sum_ += now - robot.tickEndTime;
+                stats.avgWakeNs    = wake_sum_ / stats.stampedTicks;
+                stats.avgComputeNs = compute_sum_ / stats.stampedTicks;
+                stats.avgReturnNs  = return_sum_ / stats.stampedTicks;
+            }
+        }
+#endif
+        stats_memory_().sequence.fetch_add( 1, std::memory_order_release );
+    }
 
+    VisualizationData& SimParam::GetVisualizationData()
+    {
+#ifdef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        return shared_memory_().robotToSim.visualizationData;
+#else
+        MapVisualization();
+        return visualization_memory_().visualizationData;
+#endif
+    }
+
+    CheetahVisualization& SimParam::GetMainCheetahVisualization()
+    {
+#ifdef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+        return shared_memory_().robotToSim.mainCheetahVisualization;
+#else
+        MapVisualization();
+        return visualization_memory_().mainCheetahVisualization;
+#endif
+    }
 
+#ifndef SIMULATOR_MESSAGE_LEGACY_LAYOUT
+    void SimParam::MapVisualization()
+    {
+        if ( visualization_mapped_ ) {
+            return;
+        }
+        SIM_LOG_INFO( "[Simulation] Setup visualization shared memory..." );
+        visualization_memory_.CreateNew( InstanceScopedName( DEVELOPMENT_SIMULATOR_VISUALIZATION_SHARED_MEMORY_NAME, instance_ ), true );
+        visualization_mapped_ = true;
+        shared_memory_().simToRobot.visualizationEnabled = 1;
     }
+#endif
 
     SpiCommand SimParam::ReceiveSMData()
     {
-        SpiCommand _spicommand;
-        _spicommand = shared_memory_().robotToSim.spiCommand;
-        return _spicommand;
+        return CommandView();
     }
 
     void SimParam::HandleYamlParam(const cyberdog_msg::msg::YamlParam::SharedPtr msg)
@@ -208,14 +583,27 @@ namespace gazebo
             break;
         }
 
-        bool isUser_ = false;
+        topic_paramhandler_.is_user = msg->is_user;
 
-        if(msg->is_user) {
-            isUser_=true;
+        if (!param_queue_.TryPush(topic_paramhandler_)) {
+            SIM_LOG_WARN( "[Simulation] yaml_parameter queue full, %s dropped", topic_paramhandler_.name.c_str() );
         }
+    }
 
-        SendControlParameter(topic_paramhandler_.name, topic_paramhandler_.value, topic_paramhandler_.kind, isUser_);
-
+    void SimParam::ReceiveTopic()
+    {
+        // parameters wait in the queue while no control program is connected
+        ParamHandler topic_paramhandler_;
+        while (connected_ && param_queue_.TryPop(topic_paramhandler_)) {
+            SendControlParameter(topic_paramhandler_.name, topic_paramhandler_.value, topic_paramhandler_.kind, topic_paramhandler_.is_user);
+
+            // keep the value for a control program that attaches later
+            ControlParameterCollection& collection = topic_paramhandler_.is_user ? user_parameters_.collection_ : robot_parameters_.collection_;
+            auto parameter = collection.map_.find(topic_paramhandler_.name);
+            if (parameter != collection.map_.end() && parameter->second->kind_ == topic_paramhandler_.kind) {
+                parameter->second->Set(topic_paramhandler_.value, topic_paramhandler_.kind);
+            }
+        }
     }
 
 }
\ No newline at end of file
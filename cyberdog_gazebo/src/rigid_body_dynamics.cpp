@@ -0,0 +1,207 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rigid_body_dynamics.hpp"
+
+#include <algorithm>
+
+namespace gazebo
+{
+  namespace
+  {
+    const SpatialVec3 kGravity(0, 0, -9.81);
+
+    // Dry friction is viscous below this joint speed, rad/s
+    const double kFrictionVelocity = 0.01;
+
+    // Joint limits are a stiff spring-damper, Nm/rad and Nms/rad
+    const double kLimitStiffness = 10000;
+    const double kLimitDamping = 10;
+  }
+
+  RigidBodyDynamics::RigidBodyDynamics(const RigidBodyModel &model, const ContactParameters &contact)
+  : model_(model), contact_(contact), n_(model.NumBodies())
+  {
+    contact_force_.assign(model_.Contacts().size(), SpatialVec3::Zero());
+    contact_anchor_.assign(model_.Contacts().size(), SpatialVec3::Zero());
+    in_contact_.assign(model_.Contacts().size(), false);
+    Reset(SpatialVec3::Zero(), Eigen::Quaterniond::Identity());
+  }
+
+  void RigidBodyDynamics::Reset(const SpatialVec3 &position, const Eigen::Quaterniond &orientation, const double *q)
+  {
+    time_ = 0;
+    base_position_ = position;
+    base_orientation_ = orientation.normalized();
+    for (int i = 0; i < n_; i++) {
+      q_[i] = q && i > 0 ? q[i] : 0;
+      qd_[i] = 0;
+      tau_[i] = 0;
+      v_[i].setZero();
+      a_[i].setZero();
+    }
+    std::fill(contact_force_.begin(), contact_force_.end(), SpatialVec3::Zero());
+    std::fill(in_contact_.begin(), in_contact_.end(), false);
+    Kinematics();
+  }
+
+  void RigidBodyDynamics::Kinematics()
+  {
+    rotation_[0] = base_orientation_.toRotationMatrix();
+    position_[0] = base_position_;
+    for (int i = 1; i < n_; i++) {
+      const RigidBody &body = model_.Body(i);
+      up_[i] = SpatialTransform(AxisRotation(body.axis, q_[i]).transpose(), SpatialVec3::Zero()) * body.tree;
+      s_[i] << body.axis, 0, 0, 0;
+      SpatialVec vj = s_[i] * qd_[i];
+      v_[i] = up_[i].Apply(v_[body.parent]) + vj;
+      c_[i] = MotionCross(v_[i], vj);
+      rotation_[i] = rotation_[body.parent] * up_[i].E.transpose();
+      position_[i] = position_[body.parent] + rotation_[body.parent] * up_[i].r;
+    }
+  }
+
+  void RigidBodyDynamics::ContactForces()
+  {
+    for (int i = 0; i < n_; i++) {
+      f_ext_[i].setZero();
+    }
+    const std::vector<ContactPoint> &contacts = model_.Contacts();
+    for (size_t k = 0; k < contacts.size(); k++) {
+      const ContactPoint &contact = contacts[k];
+      const SpatialMat3 &R = rotation_[contact.body];
+
+      // lowest point of the sphere, in body and world coordinates
+      SpatialVec3 local = contact.position - contact.radius * R.row(2).transpose();
+      SpatialVec3 point = position_[contact.body] + R * local;
+      if (point.z() >= 0) {
+        in_contact_[k] = false;
+        contact_force_[k].setZero();
+        continue;
+      }
+      const SpatialVec &v = v_[contact.body];
+      SpatialVec3 velocity = R * (v.tail<3>() + v.head<3>().cross(local));
+      if (!in_contact_[k]) {
+        in_contact_[k] = true;
+        contact_anchor_[k] = point;
+      }
+
+      double normal = std::max(0.0, -contact_.stiffness * point.z() - contact_.damping * velocity.z());
+      SpatialVec3 tangential = -contact_.tangential_stiffness * (point - contact_anchor_[k]) -
+                               contact_.tangential_damping * velocity;
+      tangential.z() = 0;
+      double limit = contact_.friction * normal;
+      if (tangential.norm() > limit) {
+        // sliding, drag the anchor so that the spring alone is on the cone
+        tangential *= limit / tangential.norm();
+        contact_anchor_[k] = point + tangential / contact_.tangential_stiffness;
+      }
+
+      SpatialVec3 force = tangential;
+      force.z() = normal;
+      contact_force_[k] = force;
+      SpatialVec3 body_force = R.transpose() * force;
+      f_ext_[contact.body].head<3>() += local.cross(body_force);
+      f_ext_[contact.body].tail<3>() += body_force;
+    }
+  }
+
+  void RigidBodyDynamics::Step(const double *tau, double dt)
+  {
+    ContactForces();
+
+    // Articulated inertias outwards in, gravity enters as an acceleration of the base
+    for (int i = 0; i < n_; i++) {
+      IA_[i] = model_.Body(i).inertia;
+      pA_[i] = ForceCross(v_[i], IA_[i] * v_[i]) - f_ext_[i];
+    }
+    for (int i = n_ - 1; i > 0; i--) {
+      const RigidBody &body = model_.Body(i);
+      tau_[i] = std::min(std::max(tau[i], -body.effort), body.effort);
+
+      // passive torques, implicit in the joint velocity and position of the next step
+      double passive = -body.damping * qd_[i];
+      double damping = body.damping;
+      double stiffness = 0;
+      if (std::abs(qd_[i]) < kFrictionVelocity) {
+        passive -= body.friction * qd_[i] / kFrictionVelocity;
+        damping += body.friction / kFrictionVelocity;
+      }
+      else {
+        passive -= std::copysign(body.friction, qd_[i]);
+      }
+      if (q_[i] < body.lower || q_[i] > body.upper) {
+        double limit = q_[i] < body.lower ? body.lower : body.upper;
+        passive += kLimitStiffness * (limit - q_[i]) - kLimitDamping * qd_[i] - kLimitStiffness * dt * qd_[i];
+        damping += kLimitDamping;
+        stiffness += kLimitStiffness;
+      }
+
+      U_[i] = IA_[i] * s_[i];
+      D_[i] = s_[i].dot(U_[i]) + damping * dt + stiffness * dt * dt;
+      u_[i] = tau_[i] + passive - s_[i].dot(pA_[i]);
+      SpatialMat Ia = IA_[i] - U_[i] * U_[i].transpose() / D_[i];
+      SpatialVec pa = pA_[i] + Ia * c_[i] + U_[i] * (u_[i] / D_[i]);
+      IA_[body.parent] += up_[i].TransformInertia(Ia);
+      pA_[body.parent] += up_[i].ApplyTranspose(pa);
+    }
+
+    // Accelerations inwards out, relative to free fall, i.e. what an accelerometer reads
+    a_[0] = -IA_[0].ldlt().solve(pA_[0]);
+    SpatialVec gravity;
+    gravity << 0, 0, 0, rotation_[0].transpose() * kGravity;
+    v_[0] += (a_[0] + gravity) * dt;
+    for (int i = 1; i < n_; i++) {
+      SpatialVec a = up_[i].Apply(a_[model_.Body(i).parent]) + c_[i];
+      double qdd = (u_[i] - U_[i].dot(a)) / D_[i];
+      a_[i] = a + s_[i] * qdd;
+      qd_[i] += qdd * dt;
+      q_[i] += qd_[i] * dt;
+    }
+
+    // Semi-implicit Euler of the base with the new twist
+    base_position_ += rotation_[0] * v_[0].tail<3>() * dt;
+    SpatialVec3 omega = v_[0].head<3>();
+    double angle = omega.norm() * dt;
+    if (angle > 0) {
+      base_orientation_ = base_orientation_ * Eigen::Quaterniond(Eigen::AngleAxisd(angle, omega.normalized()));
+      base_orientation_.normalize();
+    }
+    time_ += dt;
+    Kinematics();
+  }
+
+  SpatialVec3 RigidBodyDynamics::ImuAngularVelocity() const
+  {
+    const SpatialTransform &imu = model_.ImuPlacement();
+    return imu.E * v_[model_.ImuBody()].head<3>();
+  }
+
+  SpatialVec3 RigidBodyDynamics::ImuLinearAcceleration() const
+  {
+    // classical acceleration of the IMU point from the spatial one of its body
+    const SpatialTransform &imu = model_.ImuPlacement();
+    const SpatialVec &v = v_[model_.ImuBody()];
+    const SpatialVec &a = a_[model_.ImuBody()];
+    SpatialVec3 omega = v.head<3>();
+    SpatialVec3 velocity = v.tail<3>() + omega.cross(imu.r);
+    return imu.E * (a.tail<3>() + a.head<3>().cross(imu.r) + omega.cross(velocity));
+  }
+
+  Eigen::Quaterniond RigidBodyDynamics::ImuOrientation() const
+  {
+    const SpatialTransform &imu = model_.ImuPlacement();
+    return Eigen::Quaterniond(SpatialMat3(rotation_[model_.ImuBody()] * imu.E.transpose())).normalized();
+  }
+}
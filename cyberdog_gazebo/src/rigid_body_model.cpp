@@ -0,0 +1,211 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rigid_body_model.hpp"
+
+#include <urdf/model.h>
+
+namespace gazebo
+{
+  namespace
+  {
+    const char *const kLegNames[4] = {"FR", "FL", "RR", "RL"};
+    const char *const kJointNames[3] = {"abad", "hip", "knee"};
+
+    // Boxes smaller than this are sensor placeholders, not collision shapes
+    const double kMinContactBox = 0.01;
+
+    SpatialVec3 ToVector(const urdf::Vector3 &v)
+    {
+      return SpatialVec3(v.x, v.y, v.z);
+    }
+
+    SpatialMat3 ToRotation(const urdf::Rotation &q)
+    {
+      return Eigen::Quaterniond(q.w, q.x, q.y, q.z).normalized().toRotationMatrix();
+    }
+
+    // Frame of a URDF origin seen from the frame it is given in
+    SpatialTransform ToTransform(const urdf::Pose &pose)
+    {
+      return SpatialTransform::FromPose(ToRotation(pose.rotation), ToVector(pose.position));
+    }
+
+    // Point given in the frame X leads to, in the frame X starts from
+    SpatialVec3 ToParent(const SpatialTransform &X, const SpatialVec3 &point)
+    {
+      return X.r + X.E.transpose() * point;
+    }
+  }
+
+  bool RigidBodyModel::Load(const std::string &path, std::string &error)
+  {
+    urdf::Model urdf;
+    if (!urdf.initFile(path)) {
+      error = "could not parse " + path;
+      return false;
+    }
+    return Build(urdf, error);
+  }
+
+  bool RigidBodyModel::Build(const urdf::ModelInterface &urdf, std::string &error)
+  {
+    bodies_.clear();
+    contacts_.clear();
+    imu_body_ = 0;
+    imu_placement_ = SpatialTransform();
+    urdf::LinkConstSharedPtr root = urdf.getRoot();
+    if (!root) {
+      error = "the URDF has no root link";
+      return false;
+    }
+    bodies_.emplace_back();
+    bodies_[0].name = root->name;
+    if (!AddLink(urdf, *root, 0, SpatialTransform(), error)) {
+      return false;
+    }
+    if (NumBodies() > kMaxBodies) {
+      error = "the URDF has " + std::to_string(NumBodies()) + " moving bodies, at most " + std::to_string(kMaxBodies) +
+              " are supported";
+      return false;
+    }
+
+    total_mass_ = 0;
+    for (const RigidBody &body : bodies_) {
+      total_mass_ += body.inertia(5, 5);
+      if (body.inertia(5, 5) <= 0) {
+        error = "body " + body.name + " has no mass";
+        return false;
+      }
+    }
+
+    // Control program joints by name, hip and knee turn the other way
+    for (int leg = 0; leg < 4; leg++) {
+      for (int j = 0; j < 3; j++) {
+        std::string name = std::string(kLegNames[leg]) + "_" + kJointNames[j] + "_joint";
+        control_body_[leg * 3 + j] = -1;
+        control_sign_[leg * 3 + j] = j == 0 ? 1.0 : -1.0;
+        for (int i = 1; i < NumBodies(); i++) {
+          if (bodies_[i].joint == name) {
+            control_body_[leg * 3 + j] = i;
+          }
+        }
+        if (control_body_[leg * 3 + j] < 0) {
+          error = "joint " + name + " not found";
+          return false;
+        }
+      }
+      foot_contact_[leg] = -1;
+      for (size_t i = 0; i < contacts_.size(); i++) {
+        if (contacts_[i].link == std::string(kLegNames[leg]) + "_foot") {
+          foot_contact_[leg] = int(i);
+        }
+      }
+    }
+    return true;
+  }
+
+  bool RigidBodyModel::AddLink(const urdf::ModelInterface &urdf, const urdf::Link &link, int body,
+                               const SpatialTransform &placement, std::string &error)
+  {
+    if (link.inertial) {
+      const urdf::Inertial &inertial = *link.inertial;
+      SpatialMat3 rotation = ToRotation(inertial.origin.rotation);
+      SpatialMat3 inertia;
+      inertia << inertial.ixx, inertial.ixy, inertial.ixz,
+                 inertial.ixy, inertial.iyy, inertial.iyz,
+                 inertial.ixz, inertial.iyz, inertial.izz;
+      inertia = rotation * inertia * rotation.transpose();
+      SpatialMat link_inertia = SpatialInertia(inertial.mass, ToVector(inertial.origin.position), inertia);
+      bodies_[body].inertia += placement.TransformInertia(link_inertia);
+    }
+
+    for (const urdf::CollisionSharedPtr &collision : link.collision_array) {
+      if (!collision || !collision->geometry) {
+        continue;
+      }
+      SpatialTransform origin = ToTransform(collision->origin);
+      if (collision->geometry->type == urdf::Geometry::SPHERE) {
+        ContactPoint contact;
+        contact.link = link.name;
+        contact.body = body;
+        contact.position = ToParent(placement, origin.r);
+        contact.radius = static_cast<const urdf::Sphere &>(*collision->geometry).radius;
+        contacts_.push_back(contact);
+      }
+      else if (collision->geometry->type == urdf::Geometry::BOX) {
+        SpatialVec3 half = ToVector(static_cast<const urdf::Box &>(*collision->geometry).dim) / 2;
+        if (half.maxCoeff() * 2 < kMinContactBox) {
+          continue;
+        }
+        for (int corner = 0; corner < 8; corner++) {
+          SpatialVec3 offset((corner & 1 ? 1 : -1) * half[0], (corner & 2 ? 1 : -1) * half[1], (corner & 4 ? 1 : -1) * half[2]);
+          ContactPoint contact;
+          contact.link = link.name;
+          contact.body = body;
+          contact.position = ToParent(placement, ToParent(origin, offset));
+          contacts_.push_back(contact);
+        }
+      }
+    }
+
+    if (link.name == "imu_link") {
+      imu_body_ = body;
+      imu_placement_ = placement;
+    }
+
+    for (const urdf::JointSharedPtr &joint : link.child_joints) {
+      urdf::LinkConstSharedPtr child = urdf.getLink(joint->child_link_name);
+      if (!child) {
+        error = "link " + joint->child_link_name + " of joint " + joint->name + " not found";
+        return false;
+      }
+      SpatialTransform child_placement = ToTransform(joint->parent_to_joint_origin_transform) * placement;
+      if (joint->type == urdf::Joint::FIXED) {
+        if (!AddLink(urdf, *child, body, child_placement, error)) {
+          return false;
+        }
+        continue;
+      }
+      if (joint->type != urdf::Joint::REVOLUTE && joint->type != urdf::Joint::CONTINUOUS) {
+        error = "joint " + joint->name + " is neither fixed, revolute nor continuous";
+        return false;
+      }
+      RigidBody child_body;
+      child_body.name = child->name;
+      child_body.joint = joint->name;
+      child_body.parent = body;
+      child_body.tree = child_placement;
+      child_body.axis = ToVector(joint->axis).normalized();
+      if (joint->dynamics) {
+        child_body.damping = joint->dynamics->damping;
+        child_body.friction = joint->dynamics->friction;
+      }
+      if (joint->limits) {
+        if (joint->type == urdf::Joint::REVOLUTE) {
+          child_body.lower = joint->limits->lower;
+          child_body.upper = joint->limits->upper;
+        }
+        if (joint->limits->effort > 0) {
+          child_body.effort = joint->limits->effort;
+        }
+      }
+      bodies_.push_back(child_body);
+      if (!AddLink(urdf, *child, int(bodies_.size()) - 1, SpatialTransform(), error)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
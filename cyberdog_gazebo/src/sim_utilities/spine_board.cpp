@@ -4,18 +4,17 @@
 
 #include <stdio.h>
 
+#include <eigen3/Eigen/Dense>
+
 #include "sim_utilities/spine_board.hpp"
 
-/*!
- * Spine board setup (per board)
- */
-void SpineBoard::init(float sideSign, s32 board) {
-  this->board_num = board;
-  this->side_sign = sideSign;
-}
+namespace {
+typedef Eigen::Array<float, 4, 1> Lanes;
+typedef Eigen::Map<const Lanes> ConstLanes;
+}  // namespace
 
 /*!
- * Reset all data for the board
+ * Reset all data of the boards
  */
 void SpineBoard::resetData() {
   if (data == nullptr) {
@@ -25,18 +24,20 @@ void SpineBoard::resetData() {
     return;
   }
 
-  data->flags[board_num] = 0;
-  data->qd_abad[board_num] = 0.f;
-  data->qd_hip[board_num] = 0.f;
-  data->qd_knee[board_num] = 0.f;
-  data->q_abad[board_num] = 0.f;
-  data->q_hip[board_num] = 0.f;
-  data->q_knee[board_num] = 0.f;
+  for (int board = 0; board < 4; board++) {
+    data->flags[board] = 0;
+    data->qd_abad[board] = 0.f;
+    data->qd_hip[board] = 0.f;
+    data->qd_knee[board] = 0.f;
+    data->q_abad[board] = 0.f;
+    data->q_hip[board] = 0.f;
+    data->q_knee[board] = 0.f;
+  }
   data->spi_driver_status = 0;
 }
 
 /*!
- * Reset all commands for the board
+ * Reset all commands of the boards
  */
 void SpineBoard::resetCommand() {
   if (cmd == nullptr) {
@@ -46,27 +47,28 @@ void SpineBoard::resetCommand() {
     return;
   }
 
-  cmd->flags[board_num] = 0;
-  cmd->kd_abad[board_num] = 0.f;
-  cmd->kd_hip[board_num] = 0.f;
-  cmd->kd_knee[board_num] = 0.f;
-  cmd->kp_abad[board_num] = 0.f;
-  cmd->kp_hip[board_num] = 0.f;
-  cmd->kp_knee[board_num] = 0.f;
-  cmd->qd_des_abad[board_num] = 0.f;
-  cmd->qd_des_hip[board_num] = 0.f;
-  cmd->qd_des_knee[board_num] = 0.f;
-  cmd->q_des_abad[board_num] = 0.f;
-  cmd->q_des_hip[board_num] = 0.f;
-  cmd->q_des_knee[board_num] = 0.f;
-  cmd->tau_abad_ff[board_num] = 0.f;
-  cmd->tau_hip_ff[board_num] = 0.f;
-  cmd->tau_hip_ff[board_num] = 0.f;
-  cmd->tau_knee_ff[board_num] = 0.f;
+  for (int board = 0; board < 4; board++) {
+    cmd->flags[board] = 0;
+    cmd->kd_abad[board] = 0.f;
+    cmd->kd_hip[board] = 0.f;
+    cmd->kd_knee[board] = 0.f;
+    cmd->kp_abad[board] = 0.f;
+    cmd->kp_hip[board] = 0.f;
+    cmd->kp_knee[board] = 0.f;
+    cmd->qd_des_abad[board] = 0.f;
+    cmd->qd_des_hip[board] = 0.f;
+    cmd->qd_des_knee[board] = 0.f;
+    cmd->q_des_abad[board] = 0.f;
+    cmd->q_des_hip[board] = 0.f;
+    cmd->q_des_knee[board] = 0.f;
+    cmd->tau_abad_ff[board] = 0.f;
+    cmd->tau_hip_ff[board] = 0.f;
+    cmd->tau_knee_ff[board] = 0.f;
+  }
 }
 
 /*!
- * Run spine board control
+ * Run spine board control of all boards
  */
 void SpineBoard::run() {
   iter_counter++;
@@ -74,65 +76,48 @@ void SpineBoard::run() {
     printf(
         "[ERROR: SPINE board] run_spine_board_iteration called with null "
         "command or data!\n");
-    torque_out[0] = 0.f;
-    torque_out[1] = 0.f;
-    torque_out[2] = 0.f;
+    for (int i = 0; i < 3; i++) {
+      Eigen::Map<Lanes>(torque_out[i]).setZero();
+    }
     return;
   }
 
-  /// Check abad softstop ///
-  if (data->q_abad[board_num] > q_limit_p[0]) {
-    torque_out[0] = kp_softstop * (q_limit_p[0] - data->q_abad[board_num]) -
-                    kd_softstop * (data->qd_abad[board_num]) +
-                    cmd->tau_abad_ff[board_num];
-  } else if (data->q_abad[board_num] < q_limit_n[0]) {
-    torque_out[0] = kp_softstop * (q_limit_n[0] - data->q_abad[board_num]) -
-                    kd_softstop * (data->qd_abad[board_num]) +
-                    cmd->tau_abad_ff[board_num];
-  } else {
-    torque_out[0] = cmd->kp_abad[board_num] *
-                        (cmd->q_des_abad[board_num] - data->q_abad[board_num]) +
-                    cmd->kd_abad[board_num] * (cmd->qd_des_abad[board_num] -
-                                               data->qd_abad[board_num]) +
-                    cmd->tau_abad_ff[board_num];
+  /// Torque limit of each board, disabled unless bit 0, wimpy with bit 1 ///
+  Lanes torque_limits[3];
+  for (int board = 0; board < 4; board++) {
+    const float* limits = disabled_torque;
+    if (cmd->flags[board] & 0b1) {
+      limits = cmd->flags[board] & 0b10 ? wimp_torque : max_torque;
+    }
+    for (int i = 0; i < 3; i++) {
+      torque_limits[i][board] = limits[i];
+    }
   }
 
-  /// Check hip softstop ///
-  if (data->q_hip[board_num] > q_limit_p[1]) {
-    torque_out[1] = kp_softstop * (q_limit_p[1] - data->q_hip[board_num]) -
-                    kd_softstop * (data->qd_hip[board_num]) +
-                    cmd->tau_hip_ff[board_num];
-  } else if (data->q_hip[board_num] < q_limit_n[1]) {
-    torque_out[1] = kp_softstop * (q_limit_n[1] - data->q_hip[board_num]) -
-                    kd_softstop * (data->qd_hip[board_num]) +
-                    cmd->tau_hip_ff[board_num];
-  } else {
-    torque_out[1] = cmd->kp_hip[board_num] *
-                        (cmd->q_des_hip[board_num] - data->q_hip[board_num]) +
-                    cmd->kd_hip[board_num] *
-                        (cmd->qd_des_hip[board_num] - data->qd_hip[board_num]) +
-                    cmd->tau_hip_ff[board_num];
-  }
-
-  /// No knee softstop right now ///
-  torque_out[2] = cmd->kp_knee[board_num] *
-                      (cmd->q_des_knee[board_num] - data->q_knee[board_num]) +
-                  cmd->kd_knee[board_num] *
-                      (cmd->qd_des_knee[board_num] - data->qd_knee[board_num]) +
-                  cmd->tau_knee_ff[board_num];
+  const float* q[3] = {data->q_abad, data->q_hip, data->q_knee};
+  const float* qd[3] = {data->qd_abad, data->qd_hip, data->qd_knee};
+  const float* q_des[3] = {cmd->q_des_abad, cmd->q_des_hip, cmd->q_des_knee};
+  const float* qd_des[3] = {cmd->qd_des_abad, cmd->qd_des_hip, cmd->qd_des_knee};
+  const float* kp[3] = {cmd->kp_abad, cmd->kp_hip, cmd->kp_knee};
+  const float* kd[3] = {cmd->kd_abad, cmd->kd_hip, cmd->kd_knee};
+  const float* tau_ff[3] = {cmd->tau_abad_ff, cmd->tau_hip_ff, cmd->tau_knee_ff};
 
-  const float* torque_limits = disabled_torque;
+  for (int i = 0; i < 3; i++) {
+    ConstLanes q_i(q[i]);
+    ConstLanes qd_i(qd[i]);
+    ConstLanes tau_ff_i(tau_ff[i]);
+    Lanes torque = ConstLanes(kp[i]) * (ConstLanes(q_des[i]) - q_i) +
+                   ConstLanes(kd[i]) * (ConstLanes(qd_des[i]) - qd_i) + tau_ff_i;
 
-  if (cmd->flags[board_num] & 0b1) {
-    if (cmd->flags[board_num] & 0b10)
-      torque_limits = wimp_torque;
-    else
-      torque_limits = max_torque;
-  }
+    /// Softstops replace the PD law beyond the joint limits, none on the knee.
+    /// Joints are rarely past a limit, the selects only run when one is ///
+    if (has_softstop[i] && ((q_i > q_limit_p[i]) || (q_i < q_limit_n[i])).any()) {
+      Lanes over = kp_softstop * (q_limit_p[i] - q_i) - kd_softstop * qd_i + tau_ff_i;
+      Lanes under = kp_softstop * (q_limit_n[i] - q_i) - kd_softstop * qd_i + tau_ff_i;
+      torque = (q_i > q_limit_p[i]).select(over, (q_i < q_limit_n[i]).select(under, torque));
+    }
 
-  for (int i = 0; i < 3; i++) {
-    if (torque_out[i] > torque_limits[i]) torque_out[i] = torque_limits[i];
-    if (torque_out[i] < -torque_limits[i]) torque_out[i] = -torque_limits[i];
+    Eigen::Map<Lanes> out(torque_out[i]);
+    out = torque.min(torque_limits[i]).max(-torque_limits[i]);
   }
-
 }
@@ -0,0 +1,110 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "controller_stand_in.hpp"
+
+namespace gazebo
+{
+  StandInController::StandInController(const StandInConfig &config)
+  :config_(config)
+  {
+    memset(q_init_, 0, sizeof(q_init_));
+  }
+
+  void StandInController::HandleControlParameters(SimulatorMessage &msg, ControlParameterTable *table)
+  {
+    ControlParameterRequest &request = msg.simToRobot.controlParameterRequest;
+    ControlParameterResponse &response = msg.robotToSim.controlParameterResponse;
+
+    // nothing new to acknowledge
+    if (request.requestNumber == response.requestNumber) {
+      return;
+    }
+
+    // without the table the entries stay pending, the simulator reports them rejected
+    if (request.requestKind == ControlParameterRequestKind::kSET_ALL_PARAMS && table) {
+      for (u64 i = 0; i < table->count; i++) {
+        table->entries[i].status = ControlParameterStatus::kOK;
+      }
+      response.nParameters = table->count;
+    }
+
+    strcpy(response.name, request.name);
+    response.value = request.value;
+    response.parameterKind = request.parameterKind;
+    response.requestKind = request.requestKind;
+    response.requestNumber = request.requestNumber;
+  }
+
+  void StandInController::RunController(const SimulatorToRobotMessage &sim, SpiCommand &cmd)
+  {
+    const SpiData &data = sim.spiData;
+    if (iterations_ == 0) {
+      for (int leg = 0; leg < 4; leg++) {
+        q_init_[leg][0] = data.q_abad[leg];
+        q_init_[leg][1] = data.q_hip[leg];
+        q_init_[leg][2] = data.q_knee[leg];
+      }
+    }
+
+    float t = iterations_ * config_.dt;
+    float ramp = config_.ramp_time > 0.f ? std::min(1.f, t / config_.ramp_time) : 1.f;
+
+    for (int leg = 0; leg < 4; leg++) {
+      float q_des[3];
+      for (int j = 0; j < 3; j++) {
+        q_des[j] = q_init_[leg][j] + ramp * (config_.q_stand[j] - q_init_[leg][j]);
+      }
+
+      // diagonal pairs swing in anti-phase, flexing hip and knee to lift the foot
+      if (config_.mode == StandInMode::TROT && ramp >= 1.f) {
+        float phase = 2.f * M_PI * config_.trot_frequency * (t - config_.ramp_time) + ((leg == 0 || leg == 3) ? 0.f : M_PI);
+        float lift = std::max(0.f, std::sin(phase));
+        q_des[1] -= 0.5f * config_.trot_amplitude * lift;
+        q_des[2] += config_.trot_amplitude * lift;
+      }
+
+      cmd.q_des_abad[leg] = q_des[0];
+      cmd.q_des_hip[leg] = q_des[1];
+      cmd.q_des_knee[leg] = q_des[2];
+      cmd.qd_des_abad[leg] = 0.f;
+      cmd.qd_des_hip[leg] = 0.f;
+      cmd.qd_des_knee[leg] = 0.f;
+      cmd.kp_abad[leg] = config_.kp;
+      cmd.kp_hip[leg] = config_.kp;
+      cmd.kp_knee[leg] = config_.kp;
+      cmd.kd_abad[leg] = config_.kd;
+      cmd.kd_hip[leg] = config_.kd;
+      cmd.kd_knee[leg] = config_.kd;
+      cmd.tau_abad_ff[leg] = 0.f;
+      cmd.tau_hip_ff[leg] = 0.f;
+      cmd.tau_knee_ff[leg] = 0.f;
+      cmd.flags[leg] = 1;
+    }
+
+    // stand in for the computation of a real controller
+    if (config_.compute_delay_ns > 0) {
+      auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(config_.compute_delay_ns);
+      while (std::chrono::steady_clock::now() < until) {
+      }
+    }
+
+    iterations_++;
+  }
+}
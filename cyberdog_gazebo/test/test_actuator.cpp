@@ -0,0 +1,130 @@
+// Copyright (c) 2023-2023 Beijing Xiaomi Mobile Software Co., Ltd. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "actuator.hpp"
+
+using namespace gazebo;
+
+namespace
+{
+  const double kA = 0.0022;
+  const double kB = -0.0067;
+  const double kC = 1.1246;
+  const double kTauMax = 12.001;
+
+  // The inverse the current loop used before the table: Newton steps from
+  // the torque of the previous call until the current is within 1e-5
+  double BaselineTorque(double current, double tau)
+  {
+    double k_tau = 3 * kA * tau * tau + 2 * kB * tau + kC;
+    tau = tau - (kA * tau * tau * tau + kB * tau * tau + kC * tau - current) / k_tau;
+    while (fabs(kA * tau * tau * tau + kB * tau * tau + kC * tau - current) > 1e-5) {
+      k_tau = 3 * kA * tau * tau + 2 * kB * tau + kC;
+      tau = tau - (kA * tau * tau * tau + kB * tau * tau + kC * tau - current) / k_tau;
+    }
+    return tau;
+  }
+
+  // Largest difference to the baseline over [tau_begin, tau_end], the baseline
+  // starting from the torque of the previous sample as in the current loop
+  double MaxError(const ITauCurve &curve, double tau_begin, double tau_end, int samples)
+  {
+    double error = 0;
+    double tau_last = tau_begin;
+    for (int i = 0; i <= samples; i++) {
+      double current = curve.Current(tau_begin + (tau_end - tau_begin) * i / samples);
+      tau_last = BaselineTorque(current, tau_last);
+      error = std::max(error, fabs(curve.Torque(current) - tau_last));
+    }
+    return error;
+  }
+}
+
+TEST(ITauCurve, MatchesBaselineWithinTauMax)
+{
+  ITauCurve curve(kA, kB, kC, kTauMax);
+  // the baseline stops within 1e-5 A, about 1e-5 Nm at the slope of the curve
+  EXPECT_LT(MaxError(curve, -kTauMax, kTauMax, 100000), 2e-5);
+}
+
+TEST(ITauCurve, MatchesBaselineWithinTable)
+{
+  ITauCurve curve(kA, kB, kC, kTauMax);
+  EXPECT_LT(MaxError(curve, -2 * kTauMax, 2 * kTauMax, 100000), 2e-5);
+}
+
+TEST(ITauCurve, MatchesBaselineBeyondTable)
+{
+  ITauCurve curve(kA, kB, kC, kTauMax);
+  EXPECT_FALSE(curve.InTable(curve.Current(60.0)));
+  EXPECT_NEAR(curve.Torque(curve.Current(60.0)), 60.0, 1e-9);
+  EXPECT_NEAR(curve.Torque(curve.Current(-60.0)), -60.0, 1e-9);
+  EXPECT_LT(MaxError(curve, 2 * kTauMax, 200.0, 10000), 2e-5);
+  EXPECT_LT(MaxError(curve, -2 * kTauMax, -200.0, 10000), 2e-5);
+}
+
+TEST(ITauCurve, GuessBeyondTableIsClosedForm)
+{
+  // the guess alone is the root of the cubic, no iteration is left to the Newton step
+  ITauCurve curve(kA, kB, kC, kTauMax);
+  for (double tau : {-1000.0, -200.0, -2.5 * kTauMax, 2.5 * kTauMax, 200.0, 1000.0}) {
+    double current = curve.Current(tau);
+    EXPECT_FALSE(curve.InTable(current));
+    EXPECT_NEAR(curve.Guess(current), tau, 1e-9 * fabs(tau));
+    EXPECT_NEAR(curve.Torque(current), tau, 1e-9 * fabs(tau));
+  }
+}
+
+TEST(ActuatorBatch, CurrentLoopBeyondTable)
+{
+  ActuatorParameters parameters;
+  parameters.max_current_step = 100.0;
+  ActuatorBatch motor(parameters);
+  ActuatorBatch::Array12d tau = ActuatorBatch::Array12d::Zero();
+  motor.CurrentLoopResponse(tau);
+
+  // a step far beyond the table is cut to 100 A, itself beyond the table
+  tau.setConstant(500.0);
+  motor.CurrentLoopResponse(tau);
+  const ITauCurve &curve = motor.GetITauCurve(0);
+  EXPECT_FALSE(curve.InTable(100.0));
+  for (int i = 0; i < 12; i++) {
+    EXPECT_NEAR(curve.Current(tau[i]), 100.0, 1e-9);
+  }
+}
+
+TEST(ActuatorBatch, CurrentLoopLimitsCurrentStep)
+{
+  ActuatorBatch motor;
+  ActuatorBatch::Array12d tau = ActuatorBatch::Array12d::Zero();
+  motor.CurrentLoopResponse(tau);
+
+  // a step to 60 Nm is cut to a 3 A change of current
+  tau.setConstant(60.0);
+  motor.CurrentLoopResponse(tau);
+  const ITauCurve &curve = motor.GetITauCurve(0);
+  for (int i = 0; i < 12; i++) {
+    EXPECT_NEAR(curve.Current(tau[i]), 3.0, 1e-5);
+  }
+  EXPECT_EQ(motor.Counters().current_limit, 12);
+
+  // the next step starts from 3 A
+  tau.setConstant(60.0);
+  motor.CurrentLoopResponse(tau);
+  for (int i = 0; i < 12; i++) {
+    EXPECT_NEAR(curve.Current(tau[i]), 6.0, 1e-5);
+  }
+}